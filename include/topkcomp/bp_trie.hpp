@@ -0,0 +1,544 @@
+#pragma once
+
+#include "index_common.hpp"
+#include "case_fold.hpp"
+#include <sdsl/bit_vectors.hpp>
+#include <sdsl/bp_support.hpp>
+
+namespace topkcomp {
+
+// Placeholder for the leaf select structure of bp_trie for indexes which
+// map strings to leaves otherwise, e.g. index7 extracts the strings from
+// a dictionary. It takes no space; bp_trie::leaf must not be used.
+struct no_leaf_select {
+    typedef size_t size_type;
+
+    no_leaf_select() = default;
+    no_leaf_select(const sdsl::bit_vector*) {}
+
+    void set_vector(const sdsl::bit_vector*) {}
+
+    size_type serialize(std::ostream&, sdsl::structure_tree_node* =nullptr,
+                        std::string ="") const {
+        return 0;
+    }
+
+    void load(std::istream&, const sdsl::bit_vector* =nullptr) {}
+};
+
+// Compacted trie of a sorted list of strings in balanced parentheses (BP)
+// representation, as used by the trie based indexes. Nodes are identified
+// by the position of their opening parenthesis in m_bp; the i-th leaf in
+// preorder is the i-th string. The edge labels are concatenated in preorder
+// in m_labels and the start of each label is marked in m_start_bv. The
+// indexes add the weights, the range maximum structure and their own
+// navigation (e.g. a child table) around it.
+template<typename t_bv = sdsl::sd_vector<>,
+         typename t_sel= typename t_bv::select_1_type,
+         typename t_bp_support = sdsl::bp_support_sada<>,
+         typename t_bp_rnk10 = sdsl::rank_support_v5<10,2>,
+         typename t_bp_sel10 = sdsl::select_support_mcl<10,2>,
+         typename t_label = sdsl::int_vector<8>>
+class bp_trie {
+    t_label             m_labels;     // concatenation of tree labels
+    sdsl::bit_vector    m_bp;         // balanced parentheses sequence of tree
+    t_bp_support        m_bp_support; // support structure for m_bp
+    t_bp_rnk10          m_bp_rnk10;   // rank for leaf nodes in m_bp
+    t_bp_sel10          m_bp_sel10;   // select for leaf nodes in m_bp
+    t_bv                m_start_bv;   // marks start of labels in m_labels
+    t_sel               m_start_sel;  // select structure for m_start_bv
+
+    public:
+        typedef size_t size_type;
+        typedef edge_rac<t_label> t_edge_label;
+        constexpr static size_t npos = (size_t)-1;
+
+        bp_trie() = default;
+
+        // Constructor takes a sorted list of (string,weight)-pairs
+        bp_trie(const tVPSU& string_weight) : bp_trie(string_weight, no_fold()) {}
+
+        // Constructor takes an input of (string,weight)-pairs (see
+        // for_each_pair) sorted by their keys under t_fold, which are
+        // unique; the trie stores the keys
+        template<typename t_input, typename t_fold>
+        bp_trie(const t_input& string_weight, t_fold) {
+            if ( !string_weight.empty() ) {
+                build_tree<t_fold>(string_weight);
+                set_support();
+            }
+        }
+
+        bp_trie(const bp_trie& t) {
+            *this = t;
+        }
+
+        bp_trie(bp_trie&& t) {
+            *this = std::move(t);
+        }
+
+        bp_trie& operator=(const bp_trie& t) {
+            if ( this != &t ) {
+                m_labels     = t.m_labels;
+                m_bp         = t.m_bp;
+                m_bp_support = t.m_bp_support;
+                m_bp_rnk10   = t.m_bp_rnk10;
+                m_bp_sel10   = t.m_bp_sel10;
+                m_start_bv   = t.m_start_bv;
+                m_start_sel  = t.m_start_sel;
+                set_vectors();
+            }
+            return *this;
+        }
+
+        bp_trie& operator=(bp_trie&& t) {
+            if ( this != &t ) {
+                m_labels     = std::move(t.m_labels);
+                m_bp         = std::move(t.m_bp);
+                m_bp_support = std::move(t.m_bp_support);
+                m_bp_rnk10   = std::move(t.m_bp_rnk10);
+                m_bp_sel10   = std::move(t.m_bp_sel10);
+                m_start_bv   = std::move(t.m_start_bv);
+                m_start_sel  = std::move(t.m_start_sel);
+                set_vectors();
+            }
+            return *this;
+        }
+
+        // Balanced parentheses sequence; 1 opens a node, 0 closes it
+        const sdsl::bit_vector& bp() const {
+            return m_bp;
+        }
+
+        // Number of nodes
+        size_type nodes() const {
+            return m_bp.size()/2;
+        }
+
+        // Return the node whose sub tree holds the strings matching prefix
+        // or npos if there is no matching string. If cursor is not null,
+        // the search continues from the state of the previous prefix stored
+        // in it, entered nodes are appended to its path and the end of the
+        // search is recorded. child(v, c, w_edge) returns the child of v
+        // whose edge starts with c and stores its edge in w_edge, or npos.
+        template<typename t_child>
+        size_t find_node(const std::string& prefix, trie_cursor* cursor, t_child child) const {
+            // the search starts at node v with prefix[0..m-1] matched, of
+            // which the last o characters are on the edge leading to v
+            size_t v = 0, m = 0, o = 0;
+            if ( cursor != nullptr and !cursor->resume(prefix, v, m, o) ) {
+                return npos;
+            }
+            TOPKCOMP_STAGE_TIMER(prefix_range);
+            auto v_edge = edge(node_id(v));
+            while ( m < prefix.size() ) {
+                if ( o < v_edge.size() ) { // continue matching the edge
+                    if ( ((uint8_t)prefix[m]) != v_edge[o] ) { // mismatch
+                        if ( cursor != nullptr ) cursor->finish(v, o, false);
+                        return npos;
+                    }
+                    ++m; ++o;
+                } else { // edge exhausted -> search child
+                    t_edge_label w_edge;
+                    size_t w = child(v, (uint8_t)prefix[m], w_edge);
+                    if ( w == npos ) { // no matching child found
+                        if ( cursor != nullptr ) cursor->finish(v, o, false);
+                        return npos;
+                    }
+                    v = w;
+                    v_edge = w_edge;
+                    if ( cursor != nullptr ) {
+                        cursor->path.emplace_back(v, m);
+                    }
+                    ++m; o = 1;
+                }
+            }
+            if ( cursor != nullptr ) cursor->finish(v, o, true);
+            return v;
+        }
+
+        // find_node which scans the children of each node
+        size_t find_node(const std::string& prefix, trie_cursor* cursor=nullptr) const {
+            return find_node(prefix, cursor, [this](size_t v, uint8_t c, t_edge_label& w_edge) {
+                return child(v, c, w_edge);
+            });
+        }
+
+        // Return the child of v whose edge starts with c and store its edge
+        // in w_edge, or npos. The children are scanned from left to right.
+        // A string which is a prefix of another one ends in a leaf with an
+        // empty edge, which is the first child and matches no c.
+        size_t child(size_t v, uint8_t c, t_edge_label& w_edge) const {
+            if ( c == 0 ) {
+                return npos;
+            }
+            for (size_t w = v+1; m_bp[w]; w = m_bp_support.find_close(w) + 1) {
+                w_edge = edge(node_id(w));
+                if ( w_edge[0] >= c ) {
+                    return w_edge[0] == c ? w : npos;
+                }
+            }
+            return npos;
+        }
+
+        // Map from sub tree rooted at v to strings in the original array
+        t_range node_range(size_t v) const {
+            return {{m_bp_rnk10(v), m_bp_rnk10(m_bp_support.find_close(v)+1)}};
+        }
+
+        // Leaf of the string at position idx of the original array
+        size_t leaf(size_t idx) const {
+            return m_bp_sel10(idx+1)-1;
+        }
+
+       // Map node v to its unique identifier. node_id : v -> [1..N]
+        size_t node_id(size_t v) const{
+            return m_bp_support.rank(v);
+        }
+
+        // Get edge label leading to node v with node_id(v) = v_id
+        t_edge_label edge(size_t v_id) const{
+            size_t begin = m_start_sel(v_id) + 1 - v_id;
+            size_t end   = m_start_sel(v_id+1) + 1 - (v_id+1);
+            return t_edge_label(&m_labels, begin, end);
+        }
+
+        // Check if v is a leaf
+        size_t is_leaf(size_t v) const {
+            return m_bp[v+1] == 0;
+        }
+
+        // Check if v is the root node
+        size_type is_root(size_t v) const {
+            return v == 0;
+        }
+
+        // Return parent of v
+        size_type parent(size_t v) const {
+            return m_bp_support.enclose(v);
+        }
+
+        // Return all children of v
+        std::vector<size_t> children(size_t v) const {
+            std::vector<size_t> res;
+            size_t cv = v+1;
+            while ( m_bp[cv] ) {
+                res.push_back(cv);
+                cv = m_bp_support.find_close(cv) + 1;
+            }
+            return res;
+        }
+
+        // Reconstruct label at position idx of original sequence
+        std::string label(size_t idx) const {
+            // collect the edges from the leaf up to the root in reverse
+            std::string res;
+            for (size_t v = leaf(idx); ; v = parent(v)) {
+                auto e = edge(node_id(v));
+                for (size_t i=e.size(); i > 0; --i) {
+                    res.push_back(e[i-1]);
+                }
+                if ( is_root(v) )
+                    break;
+            }
+            std::reverse(res.begin(), res.end());
+            return res;
+        }
+
+        // Reconstruct label at position idx of original sequence, where
+        // depth[v_id-1] is the string depth of node v_id (see string_depths)
+        template<typename t_depth>
+        std::string label(size_t idx, const t_depth& depth) const {
+            size_t v = leaf(idx);
+            size_t v_id = node_id(v);
+            std::string res(depth[v_id-1], '\0');
+            copy_label(v, v_id, 0, depth, res);
+            return res;
+        }
+
+        // String depth of each node in preorder, i.e. the length of the
+        // concatenated labels from the root to the node
+        sdsl::int_vector<> string_depths() const {
+            using namespace sdsl;
+            int_vector<> depth(nodes(), 0, 64);
+            tVU path(1, 0); // string depths of the open nodes
+            for (size_t v=0, v_id=1; v < m_bp.size(); ++v) {
+                if ( m_bp[v] ) {
+                    path.push_back(path.back() + edge(v_id).size());
+                    depth[v_id-1] = path.back();
+                    ++v_id;
+                } else {
+                    path.pop_back();
+                }
+            }
+            util::bit_compress(depth);
+            return depth;
+        }
+
+        // Precomputed top-k lists of all nodes with at least
+        // t_cache::min_size() strings in their sub tree. top_k(r) returns the
+        // top indexes of range r and label(idx) the string idx.
+        template<typename t_cache, typename t_top_k, typename t_label_of>
+        t_cache build_cache(t_top_k top_k, t_label_of label_of) const {
+            if ( !t_cache::enabled )
+                return t_cache();
+            tVU node_ids, node_pos;
+            for (size_t v=0; v < m_bp.size(); ++v) {
+                if ( m_bp[v] ) {
+                    auto r = node_range(v);
+                    if ( r[1]-r[0] >= t_cache::min_size() ) {
+                        node_ids.push_back(node_id(v));
+                        node_pos.push_back(v);
+                    }
+                }
+            }
+            return t_cache(node_ids, nodes(),
+                           [&](size_t i) { return top_k(node_range(node_pos[i])); },
+                           label_of);
+        }
+
+        // Decode the strings at indexes top_idx with their weights into
+        // arena, in the order of top_idx. The strings are decoded in
+        // lexicographic order while the path from the root to the current
+        // leaf is kept in the arena. So each result only walks up to the
+        // deepest ancestor it shares with the previous result and copies
+        // the common part of the label. spell(idx, label, text) appends
+        // string idx, whose trie label is label, to text.
+        template<typename t_rac_weight, typename t_spell>
+        void decode(const tVU& top_idx, const t_rac_weight& weight, result_arena& arena,
+                    t_spell spell) const {
+            auto& path = arena.path;         // nodes from root to current leaf
+            auto& path_len = arena.path_len; // label length at end of each node
+            auto& up = arena.up;
+            auto& cur = arena.cur;           // label of the current leaf
+            path.clear(); path_len.clear(); cur.clear();
+            decode_results(top_idx, weight, arena, [&](size_t idx, std::string& text) {
+                size_t v = leaf(idx);
+                // remove nodes which are no ancestors of v
+                while ( !path.empty() and m_bp_support.find_close(path.back()) < v ) {
+                    path.pop_back();
+                    path_len.pop_back();
+                }
+                // walk up to the deepest ancestor on the path
+                up.clear();
+                size_t w = v;
+                while ( path.empty() or w != path.back() ) {
+                    up.push_back(w);
+                    if ( is_root(w) )
+                        break;
+                    w = parent(w);
+                }
+                cur.resize(path_len.empty() ? 0 : path_len.back());
+                for (size_t j=up.size(); j > 0; --j) {
+                    auto e = edge(node_id(up[j-1]));
+                    cur.append(e.begin(), e.end());
+                    path.push_back(up[j-1]);
+                    path_len.push_back(cur.size());
+                }
+                spell(idx, cur, text);
+            });
+        }
+
+        // Decode the strings, which are their trie labels, into arena
+        template<typename t_rac_weight>
+        void decode(const tVU& top_idx, const t_rac_weight& weight, result_arena& arena) const {
+            decode(top_idx, weight, arena, [](size_t, const std::string& label, std::string& text){
+                text.append(label);
+            });
+        }
+
+        // decode for tries with string depths (see label(idx, depth)). The
+        // label of the previous result is kept in the arena, so each result
+        // only copies the part below the deepest ancestor it shares with
+        // the previous one.
+        template<typename t_rac_weight, typename t_depth>
+        void decode(const tVU& top_idx, const t_rac_weight& weight, const t_depth& depth,
+                    result_arena& arena) const {
+            auto& cur = arena.cur; // label of the previous result
+            size_t prev = 0;       // leaf of the previous result
+            cur.clear();
+            decode_results(top_idx, weight, arena, [&](size_t idx, std::string& text) {
+                size_t v = leaf(idx);
+                size_t v_id = node_id(v);
+                cur.resize(depth[v_id-1]);
+                copy_label(v, v_id, prev, depth, cur);
+                prev = v;
+                text.append(cur);
+            });
+        }
+
+        // Serialize method (calls serialize method of each member)
+        size_type
+        serialize(std::ostream& out, sdsl::structure_tree_node* v=nullptr,
+                  std::string name="") const {
+            using namespace sdsl;
+            auto child = structure_tree::add_child(v, name, util::class_name(*this));
+            size_type written_bytes = 0;
+            written_bytes += m_labels.serialize(out, child, "labels");
+            written_bytes += m_bp.serialize(out, child, "bp");
+            written_bytes += m_bp_support.serialize(out, child, "bp_support");
+            written_bytes += m_bp_rnk10.serialize(out, child, "bp_rnk10");
+            written_bytes += m_bp_sel10.serialize(out, child, "bp_sel10");
+            written_bytes += m_start_bv.serialize(out, child, "start_bv");
+            written_bytes += m_start_sel.serialize(out, child, "start_sel");
+            structure_tree::add_size(child, written_bytes);
+            return written_bytes;
+        }
+
+        // Load method (calls load method of each member)
+        void load(std::istream& in) {
+            m_labels.load(in);
+            m_bp.load(in);
+            m_bp_support.load(in, &m_bp);
+            m_bp_rnk10.load(in);
+            m_bp_sel10.load(in);
+            m_start_bv.load(in);
+            m_start_sel.load(in);
+            set_vectors();
+        }
+
+    private:
+
+        // Build the support structures of m_bp and m_start_bv
+        void set_support() {
+            m_start_sel  = t_sel(&m_start_bv);
+            m_bp_support = t_bp_support(&m_bp);
+            m_bp_rnk10   = t_bp_rnk10(&m_bp);
+            m_bp_sel10   = t_bp_sel10(&m_bp);
+        }
+
+        // Point the support structures to the members of this trie
+        void set_vectors() {
+            m_bp_support.set_vector(&m_bp);
+            m_bp_rnk10.set_vector(&m_bp);
+            m_bp_sel10.set_vector(&m_bp);
+            m_start_sel.set_vector(&m_start_bv);
+        }
+
+        // Copy the label of node v with node_id(v) = v_id into
+        // res[0..depth[v_id-1]), where depth holds the string depths of the
+        // nodes. Ancestors u < stop, and their labels in res, are kept.
+        // The edge labels are stored in preorder, so the edges of a chain
+        // of first children, where the parent of u is u-1, are contiguous.
+        // Each such run is copied at once and only the top of a run costs
+        // an enclose. Ancestors of string depth 0 are not visited.
+        template<typename t_depth>
+        void copy_label(size_t v, size_t v_id, size_t stop, const t_depth& depth,
+                        std::string& res) const {
+            size_t d = depth[v_id-1];
+            while ( d > 0 ) {
+                size_t end = m_start_sel(v_id+1) + 1 - (v_id+1); // end of the run
+                while ( v > stop and m_bp[v-1] ) { // climb the first child chain
+                    --v; --v_id;
+                }
+                size_t w = 0, w_id = 0, w_d = 0; // parent of the top of the run
+                if ( !is_root(v) ) {
+                    if ( m_bp[v-1] ) {
+                        w = v-1; w_id = v_id-1;
+                    } else {
+                        w = parent(v); w_id = node_id(w);
+                    }
+                    w_d = depth[w_id-1];
+                }
+                t_edge_label e(&m_labels, end-(d-w_d), end);
+                std::copy(e.begin(), e.end(), res.begin()+w_d);
+                if ( w < stop ) {
+                    break;
+                }
+                v = w; v_id = w_id; d = w_d;
+            }
+        }
+
+        // Build balanced parentheses sequence of the trie of the keys. The
+        // keys are read sequentially, so they can be folded on the fly: the
+        // 1st pass gets their sizes, the 2nd the longest common prefixes
+        // lcp[i] of the keys i-1 and i. An inner node is a maximal interval
+        // of leaves whose keys share a prefix longer than the lcp at its
+        // borders; the 3rd pass, which only reads lcp, stores the string
+        // depths of the inner nodes whose leftmost leaf is i. The 4th pass
+        // writes the parentheses and edge labels in preorder.
+        template<typename t_fold, typename t_input>
+        void build_tree(const t_input& string_weight) {
+            using namespace sdsl;
+            size_t N = 0, n = 0, max_len = 0;
+            for_each_key<t_fold>(string_weight, [&](size_t, const std::string& key) {
+                ++N;
+                n += key.size();
+                max_len = std::max(max_len, key.size());
+            });
+            uint8_t width = bits::hi(max_len+1)+1;
+            int_vector<> lcp(N, 0, width);
+            {
+                std::string prev;
+                for_each_key<t_fold>(string_weight, [&](size_t i, const std::string& key) {
+                    size_t l = 0;
+                    while ( l < prev.size() and l < key.size() and prev[l] == key[l] ) {
+                        ++l;
+                    }
+                    lcp[i] = l;
+                    prev = key;
+                });
+            }
+            // inner nodes with leftmost leaf i: depth[..] in increasing
+            // order, cnt[i] of them; an inner node has at least two
+            // children, so there are less than N
+            int_vector<> cnt(N, 0, width);
+            int_vector<> depth(N, 0, width);
+            {
+                std::vector<uint64_t> minima; // prefix minima of lcp[i+1..N)
+                size_t d = N;
+                for (size_t i=N; i-- > 0; ) {
+                    // the root starts at leaf 0 and ends all intervals
+                    while ( !minima.empty() and (i == 0 or minima.back() > lcp[i]) ) {
+                        depth[--d] = minima.back();
+                        minima.pop_back();
+                        ++cnt[i];
+                    }
+                    if ( !minima.empty() and minima.back() == lcp[i] ) {
+                        minima.pop_back();
+                    }
+                    minima.push_back(lcp[i]);
+                }
+                std::copy(depth.begin()+d, depth.end(), depth.begin());
+            }
+            bit_vector start_bv(2*N+n+2, 0);   // initialize to worst case size
+            int_vector<8> labels(n);           // initialize to worst case size
+            m_bp       = bit_vector(2*2*N, 0); // initialize to worst case size
+            size_t bp = 0, start = 0, label = 0, d = 0;
+            start_bv[start++] = 1;             // mark start of first label
+            std::vector<uint64_t> open;        // string depths of the open inner nodes
+            for_each_key<t_fold>(string_weight, [&](size_t i, const std::string& key) {
+                if ( i > 0 ) {
+                    ++bp; // close the previous leaf and the nodes it ends
+                    while ( !open.empty() and open.back() > lcp[i] ) {
+                        open.pop_back();
+                        ++bp;
+                    }
+                }
+                size_t p = open.empty() ? 0 : open.back();
+                auto add_node = [&](size_t end) {
+                    m_bp[bp++] = 1;
+                    for (; p < end; ++p) {
+                        labels[label++] = (uint8_t)key[p];
+                        ++start;
+                    }
+                    start_bv[start++] = 1; // mark end of edge label
+                };
+                for (size_t j=0; j < cnt[i]; ++j) {
+                    open.push_back(depth[d++]);
+                    add_node(open.back());
+                }
+                add_node(key.size());
+            });
+            bp += 1 + open.size(); // close the last leaf and its ancestors
+            m_bp.resize(bp);            // resize to actual size
+            labels.resize(label);       // resize to actual size
+            start_bv.resize(start);     // resize to actual size
+
+            construct_labels(m_labels, labels);
+
+            m_start_bv = t_bv(start_bv);     // copy to member bitvector
+        }
+};
+
+} // end namespace topkcomp
@@ -0,0 +1,293 @@
+#pragma once
+
+#include "index_common.hpp"
+#include <string>
+#include <cctype>
+#include <cstdint>
+#include <type_traits>
+
+namespace topkcomp {
+
+    // Decode the UTF-8 sequence at s[i..] into cp
+    // \returns the length of the sequence or 0 if it is not valid UTF-8
+    inline size_t utf8_decode(const std::string& s, size_t i, uint32_t& cp) {
+        auto byte = [&](size_t j) -> uint32_t { return i+j < s.size() ? (uint8_t)s[i+j] : 0; };
+        auto cont = [&](size_t j) { return (byte(j) & 0xC0) == 0x80; };
+        uint32_t b0 = byte(0);
+        if ( b0 < 0x80 ) {
+            cp = b0;
+            return 1;
+        }
+        if ( b0 >= 0xC2 and b0 <= 0xDF and cont(1) ) {
+            cp = ((b0 & 0x1F) << 6) | (byte(1) & 0x3F);
+            return 2;
+        }
+        if ( b0 >= 0xE0 and b0 <= 0xEF and cont(1) and cont(2) ) {
+            cp = ((b0 & 0x0F) << 12) | ((byte(1) & 0x3F) << 6) | (byte(2) & 0x3F);
+            // no overlong encodings and surrogates
+            return (cp >= 0x800 and (cp < 0xD800 or cp > 0xDFFF)) ? 3 : 0;
+        }
+        if ( b0 >= 0xF0 and b0 <= 0xF4 and cont(1) and cont(2) and cont(3) ) {
+            cp = ((b0 & 0x07) << 18) | ((byte(1) & 0x3F) << 12) | ((byte(2) & 0x3F) << 6) | (byte(3) & 0x3F);
+            return (cp >= 0x10000 and cp <= 0x10FFFF) ? 4 : 0;
+        }
+        return 0;
+    }
+
+    // Append the UTF-8 encoding of cp to res
+    inline void utf8_encode(uint32_t cp, std::string& res) {
+        if ( cp < 0x80 ) {
+            res.push_back(cp);
+        } else if ( cp < 0x800 ) {
+            res.push_back(0xC0 | (cp >> 6));
+            res.push_back(0x80 | (cp & 0x3F));
+        } else if ( cp < 0x10000 ) {
+            res.push_back(0xE0 | (cp >> 12));
+            res.push_back(0x80 | ((cp >> 6) & 0x3F));
+            res.push_back(0x80 | (cp & 0x3F));
+        } else {
+            res.push_back(0xF0 | (cp >> 18));
+            res.push_back(0x80 | ((cp >> 12) & 0x3F));
+            res.push_back(0x80 | ((cp >> 6) & 0x3F));
+            res.push_back(0x80 | (cp & 0x3F));
+        }
+    }
+
+    // Unicode simple case folding of the letters of Latin (except the
+    // African and phonetic letters of Latin Extended-B), Greek, Cyrillic
+    // and Armenian alphabets, the letterlike symbols and the fullwidth
+    // Latin letters. Other code points are returned unchanged.
+    inline uint32_t utf8_simple_fold(uint32_t c) {
+        if ( c < 0x80 ) {
+            return (c >= 'A' and c <= 'Z') ? c+32 : c;
+        }
+        if ( c < 0x100 ) { // Latin-1
+            if ( c == 0xB5 ) return 0x3BC; // micro sign
+            return (c >= 0xC0 and c <= 0xDE and c != 0xD7) ? c+32 : c;
+        }
+        if ( c < 0x180 ) { // Latin Extended-A: pairs of upper and lower case
+            if ( c == 0x130 or c == 0x131 or c == 0x138 or c == 0x149 ) return c;
+            if ( c == 0x178 ) return 0xFF;
+            if ( c == 0x17F ) return 's';
+            if ( (c >= 0x139 and c <= 0x148) or (c >= 0x179 and c <= 0x17E) ) return c + (c & 1);
+            return c | 1;
+        }
+        if ( c < 0x250 ) { // Latin Extended-B: the pairs of the Latin alphabets
+            if ( c >= 0x1CD and c <= 0x1DC ) return c + (c & 1);
+            if ( c == 0x1F4 ) return 0x1F5;
+            if ( (c >= 0x1DE and c <= 0x1EF) or (c >= 0x1F8 and c <= 0x21F) or
+                 (c >= 0x222 and c <= 0x233) ) return c | 1;
+            return c;
+        }
+        if ( c >= 0x370 and c < 0x400 ) { // Greek
+            if ( c == 0x386 ) return 0x3AC;
+            if ( c >= 0x388 and c <= 0x38A ) return c + 37;
+            if ( c == 0x38C ) return 0x3CC;
+            if ( c == 0x38E or c == 0x38F ) return c + 63;
+            if ( (c >= 0x391 and c <= 0x3A1) or (c >= 0x3A3 and c <= 0x3AB) ) return c + 32;
+            if ( c == 0x3C2 ) return 0x3C3; // final sigma
+            if ( c >= 0x3D8 and c <= 0x3EF ) return c | 1;
+            return c;
+        }
+        if ( c >= 0x400 and c < 0x530 ) { // Cyrillic
+            if ( c < 0x410 ) return c + 80;
+            if ( c < 0x430 ) return c + 32;
+            if ( (c >= 0x460 and c <= 0x481) or (c >= 0x48A and c <= 0x4BF) or
+                 (c >= 0x4D0 and c <= 0x52F) ) return c | 1;
+            if ( c == 0x4C0 ) return 0x4CF;
+            if ( c >= 0x4C1 and c <= 0x4CE ) return c + (c & 1);
+            return c;
+        }
+        if ( c >= 0x531 and c <= 0x556 ) return c + 48; // Armenian
+        if ( c >= 0x1E00 and c < 0x1F00 ) { // Latin Extended Additional
+            if ( c == 0x1E9E ) return 0xDF;
+            return (c <= 0x1E95 or c >= 0x1EA0) ? (c | 1) : c;
+        }
+        if ( c == 0x2126 ) return 0x3C9; // ohm sign
+        if ( c == 0x212A ) return 'k';   // kelvin sign
+        if ( c == 0x212B ) return 0xE5;  // angstrom sign
+        if ( c >= 0xFF21 and c <= 0xFF3A ) return c + 32; // fullwidth Latin
+        return c;
+    }
+
+    // Base letter of a folded Latin letter with diacritic or stroke and
+    // of Greek vowels with tonos or dialytika. Combining diacritical marks
+    // are mapped to 0, i.e. removed.
+    inline uint32_t utf8_strip_accent(uint32_t c) {
+        // U+00E0..U+00FF and U+0100..U+017F; '.' is a letter without base letter
+        static const char latin1[]    = "aaaaaa.ceeeeiiii.nooooo.ouuuuy.y";
+        static const char latin_ext[] = "aaaaaaccccccccddddeeeeeeeeeegggggggghhhhiiiiiiiiii..jjkk."
+                                        "llllllllllnnnnnn...oooooo..rrrrrrssssssssttttttuuuuuuuuuuuu"
+                                        "wwyyyzzzzzzs";
+        if ( c < 0xE0 ) {
+            return c;
+        }
+        if ( c < 0x100 ) {
+            return latin1[c-0xE0] == '.' ? c : latin1[c-0xE0];
+        }
+        if ( c < 0x180 ) {
+            return latin_ext[c-0x100] == '.' ? c : latin_ext[c-0x100];
+        }
+        if ( c >= 0x300 and c <= 0x36F ) {
+            return 0;
+        }
+        switch ( c ) {
+            case 0x3AC: return 0x3B1;
+            case 0x3AD: return 0x3B5;
+            case 0x3AE: return 0x3B7;
+            case 0x3AF: case 0x390: case 0x3CA: return 0x3B9;
+            case 0x3CC: return 0x3BF;
+            case 0x3CD: case 0x3B0: case 0x3CB: return 0x3C5;
+            case 0x3CE: return 0x3C9;
+            case 0x451: return 0x435; // Cyrillic yo
+        }
+        return c;
+    }
+
+    // Case folding of the strings of an index to their search keys. A
+    // fold provides key(s), the key of string s, and fold(s, out), which
+    // calls out(begin, len, f) for each unit s[begin..begin+len) of s with
+    // its folded form f; the key is the concatenation of the f. name()
+    // identifies the fold in files.
+
+    // Case sensitive indexes: each string is its own key
+    struct no_fold {
+        constexpr static bool identity = true;
+
+        static const char* name() {
+            return "none";
+        }
+
+        static std::string key(const std::string& s) {
+            return s;
+        }
+    };
+
+    // Byte-wise lower case of ASCII letters
+    struct ascii_fold {
+        constexpr static bool identity = false;
+
+        static const char* name() {
+            return "ascii";
+        }
+
+        template<typename t_out>
+        static void fold(const std::string& s, t_out out) {
+            std::string f(1, '\0');
+            for (size_t i=0; i < s.size(); ++i) {
+                f[0] = std::tolower((uint8_t)s[i]);
+                out(i, 1, f);
+            }
+        }
+
+        static std::string key(std::string s) {
+            for (auto& c : s) {
+                c = std::tolower((uint8_t)c);
+            }
+            return s;
+        }
+    };
+
+    // Simple case folding of UTF-8 strings, optionally followed by the
+    // removal of accents. Bytes which are not valid UTF-8 are kept.
+    template<bool t_strip_accents=false>
+    struct utf8_fold {
+        constexpr static bool identity = false;
+
+        static const char* name() {
+            return t_strip_accents ? "utf8_strip_accents" : "utf8";
+        }
+
+        template<typename t_out>
+        static void fold(const std::string& s, t_out out) {
+            std::string f;
+            for (size_t i=0; i < s.size(); ) {
+                uint32_t cp;
+                size_t len = utf8_decode(s, i, cp);
+                f.clear();
+                if ( len == 0 ) {
+                    len = 1;
+                    f.push_back(s[i]);
+                } else {
+                    cp = utf8_simple_fold(cp);
+                    if ( t_strip_accents ) {
+                        cp = utf8_strip_accent(cp);
+                    }
+                    if ( cp != 0 ) {
+                        utf8_encode(cp, f);
+                    }
+                }
+                out(i, len, f);
+                i += len;
+            }
+        }
+
+        static std::string key(const std::string& s) {
+            std::string res;
+            res.reserve(s.size());
+            fold(s, [&](size_t, size_t, const std::string& f){ res += f; });
+            return res;
+        }
+    };
+
+    // Key of s under the fold with the given name; used by programs which
+    // read the fold from a file, e.g. the front end of a sharded index
+    inline std::string fold_key(const std::string& fold, const std::string& s) {
+        if ( fold == ascii_fold::name() ) {
+            return ascii_fold::key(s);
+        } else if ( fold == utf8_fold<>::name() ) {
+            return utf8_fold<>::key(s);
+        } else if ( fold == utf8_fold<true>::name() ) {
+            return utf8_fold<true>::key(s);
+        }
+        return s;
+    }
+
+    // Call f(i, key) for the key of each string of an input of (string,
+    // weight)-pairs (see for_each_pair). The keys are folded one at a
+    // time, so the list of keys is never materialized; strings are their
+    // own keys under an identity fold and are passed without a copy.
+    template<typename t_fold, typename t_input, typename t_f>
+    void for_each_key(const t_input& string_weight, t_f f, std::true_type) {
+        for_each_pair(string_weight, [&](size_t i, const std::string& s, uint64_t) {
+            f(i, s);
+        });
+    }
+
+    template<typename t_fold, typename t_input, typename t_f>
+    void for_each_key(const t_input& string_weight, t_f f, std::false_type) {
+        for_each_pair(string_weight, [&](size_t i, const std::string& s, uint64_t) {
+            f(i, t_fold::key(s));
+        });
+    }
+
+    template<typename t_fold, typename t_input, typename t_f>
+    void for_each_key(const t_input& string_weight, t_f f) {
+        for_each_key<t_fold>(string_weight, f, std::integral_constant<bool, t_fold::identity>());
+    }
+
+    // Fold of the indexes which only declare whether they are case sensitive
+    template<bool t_case_sensitive>
+    struct default_fold {
+        typedef no_fold type;
+    };
+
+    template<>
+    struct default_fold<false> {
+        typedef ascii_fold type;
+    };
+
+    // Fold of t_index: t_index::fold_type if it is declared, otherwise the
+    // default fold for t_index::case_sensitive
+    template<typename t_index, typename = void>
+    struct index_fold {
+        typedef typename default_fold<t_index::case_sensitive>::type type;
+    };
+
+    template<typename t_index>
+    struct index_fold<t_index,
+        typename std::conditional<true, void, typename t_index::fold_type>::type> {
+        typedef typename t_index::fold_type type;
+    };
+
+} // end namespace topkcomp
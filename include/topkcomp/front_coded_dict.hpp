@@ -0,0 +1,114 @@
+#pragma once
+
+#include "index_common.hpp"
+#include <sdsl/int_vector.hpp>
+
+namespace topkcomp {
+
+// Sorted strings in blocks of t_block_size strings. The first string of
+// a block is stored as varint length followed by its characters; each
+// other string as the varint length of the common prefix with its
+// predecessor, the varint length of the remaining suffix and the suffix.
+// Extracting string idx decodes its block up to idx, so larger blocks
+// take less space and more time.
+template<uint32_t t_block_size = 16>
+class front_coded_dict {
+    static_assert(t_block_size > 0, "a block holds at least one string");
+
+    uint64_t            m_size = 0; // number of strings
+    sdsl::int_vector<8> m_data;     // front coded blocks
+    sdsl::int_vector<>  m_block;    // start of the i-th block in m_data
+
+    public:
+        typedef size_t size_type;
+
+        // Decoding state: str is the string idx, which ends at position p
+        // of m_data. Extracting a later string of the same block continues
+        // from there.
+        struct cursor {
+            size_t      idx = (size_t)-1;
+            size_t      p   = 0;
+            std::string str;
+        };
+
+        front_coded_dict() = default;
+
+        // Constructor takes a sorted list of (string,weight)-pairs
+        front_coded_dict(const tVPSU& string_weight) : m_size(string_weight.size()) {
+            using namespace sdsl;
+            std::string data;
+            tVU block;
+            for (size_t i=0; i < m_size; ++i) {
+                const auto& s = string_weight[i].first;
+                size_t l = 0;
+                if ( i % t_block_size == 0 ) {
+                    block.push_back(data.size());
+                } else {
+                    l = lcp(string_weight[i-1].first, s);
+                    put_varint(l, data);
+                }
+                put_varint(s.size()-l, data);
+                data.append(s, l, std::string::npos);
+            }
+            m_data = int_vector<8>(data.size());
+            std::copy(data.begin(), data.end(), m_data.begin());
+            m_block = int_vector<>(block.size(), 0, bits::hi(data.size())+1);
+            std::copy(block.begin(), block.end(), m_block.begin());
+        }
+
+        // Number of strings
+        size_type size() const {
+            return m_size;
+        }
+
+        // String idx; continues the decoding of cursor c if it is located
+        // before idx in the same block
+        const std::string& extract(size_t idx, cursor& c) const {
+            size_t b = idx / t_block_size;
+            if ( c.idx > idx or c.idx / t_block_size != b ) {
+                c.p = m_block[b];
+                size_t len = get_varint(m_data, c.p);
+                c.str.assign(m_data.begin()+c.p, m_data.begin()+c.p+len);
+                c.p += len;
+                c.idx = b * t_block_size;
+            }
+            while ( c.idx < idx ) {
+                size_t l   = get_varint(m_data, c.p);
+                size_t len = get_varint(m_data, c.p);
+                c.str.resize(l);
+                c.str.append(m_data.begin()+c.p, m_data.begin()+c.p+len);
+                c.p += len;
+                ++c.idx;
+            }
+            return c.str;
+        }
+
+        // String idx
+        std::string operator[](size_t idx) const {
+            cursor c;
+            return extract(idx, c);
+        }
+
+        // Serialize method
+        size_type
+        serialize(std::ostream& out, sdsl::structure_tree_node* v=nullptr,
+                  std::string name="") const {
+            using namespace sdsl;
+            auto child = structure_tree::add_child(v, name, util::class_name(*this));
+            size_type written_bytes = 0;
+            written_bytes += write_member(m_size, out, child, "size");
+            written_bytes += m_data.serialize(out, child, "data");
+            written_bytes += m_block.serialize(out, child, "block");
+            structure_tree::add_size(child, written_bytes);
+            return written_bytes;
+        }
+
+        // Load method
+        void load(std::istream& in) {
+            sdsl::read_member(m_size, in);
+            m_data.load(in);
+            m_block.load(in);
+        }
+};
+
+} // end namespace topkcomp
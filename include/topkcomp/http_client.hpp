@@ -0,0 +1,226 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <cerrno>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+namespace topkcomp {
+
+// Minimal HTTP/1.0 client for the requests of a front end to its
+// shards. It understands plain and chunked responses, which is all the
+// web server sends. get_all sends a request to several servers at once
+// over non-blocking sockets and waits for the answers with poll() in the
+// calling thread, so a query needs no thread per shard.
+class http_client {
+    public:
+        // GET path from address host:port
+        // \returns false if the shard can not be reached, does not answer
+        //          within timeout_ms or does not answer with status 200
+        static bool get(const std::string& address, const std::string& path,
+                        std::string& body, int timeout_ms=2000) {
+            std::vector<std::string> bodies;
+            bool ok = get_all({address}, path, bodies, timeout_ms)[0];
+            body.swap(bodies[0]);
+            return ok;
+        }
+
+        // GET path from all addresses in parallel; the answer of
+        // addresses[i] is stored in bodies[i]
+        // \returns ok[i] = false if addresses[i] can not be reached, does
+        //          not answer within timeout_ms or not with status 200
+        static std::vector<bool> get_all(const std::vector<std::string>& addresses,
+                                         const std::string& path,
+                                         std::vector<std::string>& bodies,
+                                         int timeout_ms=2000) {
+            struct request {
+                int         fd = -1;
+                std::string out;       // unsent part of the request
+                std::string in;        // received part of the response
+                bool        connected = false;
+            };
+            std::vector<request> reqs(addresses.size());
+            std::vector<bool> ok(addresses.size(), false);
+            bodies.assign(addresses.size(), "");
+            for (size_t i=0; i < addresses.size(); ++i) {
+                size_t colon = addresses[i].rfind(':');
+                if ( colon == std::string::npos ) {
+                    continue;
+                }
+                std::string host = addresses[i].substr(0, colon);
+                reqs[i].fd  = connect_to(host, addresses[i].substr(colon+1));
+                reqs[i].out = "GET " + path + " HTTP/1.0\r\nHost: " + host +
+                              "\r\nConnection: close\r\n\r\n";
+            }
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+            auto finish = [&](size_t i) {
+                close(reqs[i].fd);
+                reqs[i].fd = -1;
+            };
+            for (;;) {
+                std::vector<struct pollfd> fds;
+                std::vector<size_t> req_of;
+                for (size_t i=0; i < reqs.size(); ++i) {
+                    if ( reqs[i].fd >= 0 ) {
+                        fds.push_back({reqs[i].fd, (short)(reqs[i].out.empty() ? POLLIN : POLLOUT), 0});
+                        req_of.push_back(i);
+                    }
+                }
+                auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                deadline - std::chrono::steady_clock::now()).count();
+                if ( fds.empty() or left <= 0 ) {
+                    break;
+                }
+                if ( poll(fds.data(), fds.size(), (int)left) < 0 and errno != EINTR ) {
+                    break;
+                }
+                for (size_t j=0; j < fds.size(); ++j) {
+                    size_t i = req_of[j];
+                    request& r = reqs[i];
+                    if ( fds[j].revents == 0 ) {
+                        continue;
+                    }
+                    if ( !r.connected ) { // the non-blocking connect finished
+                        int err = 0;
+                        socklen_t len = sizeof(err);
+                        if ( getsockopt(r.fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0 or err != 0 ) {
+                            finish(i);
+                            continue;
+                        }
+                        r.connected = true;
+                    }
+                    if ( !r.out.empty() ) {
+                        ssize_t n = send(r.fd, r.out.data(), r.out.size(), MSG_NOSIGNAL);
+                        if ( n < 0 and errno != EAGAIN and errno != EWOULDBLOCK ) {
+                            finish(i);
+                        } else if ( n > 0 ) {
+                            r.out.erase(0, n);
+                        }
+                        continue;
+                    }
+                    char tmp[4096];
+                    ssize_t n = recv(r.fd, tmp, sizeof(tmp), 0);
+                    if ( n < 0 ) {
+                        if ( errno != EAGAIN and errno != EWOULDBLOCK ) {
+                            finish(i);
+                        }
+                        continue;
+                    }
+                    r.in.append(tmp, n);
+                    int state = parse_response(r.in, n == 0, bodies[i]);
+                    if ( state != 0 ) {
+                        ok[i] = state > 0;
+                        finish(i);
+                    }
+                }
+            }
+            for (size_t i=0; i < reqs.size(); ++i) {
+                if ( reqs[i].fd >= 0 ) { // timed out
+                    finish(i);
+                }
+            }
+            return ok;
+        }
+
+        // Percent-encode s for the query string of an url
+        static std::string url_encode(const std::string& s) {
+            static const char hex[] = "0123456789ABCDEF";
+            std::string res;
+            for (unsigned char c : s) {
+                if ( std::isalnum(c) or c == '-' or c == '_' or c == '.' or c == '~' ) {
+                    res += c;
+                } else {
+                    res += '%';
+                    res += hex[c >> 4];
+                    res += hex[c & 15];
+                }
+            }
+            return res;
+        }
+
+    private:
+        // Start a non-blocking connect to host:port
+        // \returns the socket or -1
+        static int connect_to(const std::string& host, const std::string& port) {
+            struct addrinfo hints, *res = nullptr;
+            memset(&hints, 0, sizeof(hints));
+            hints.ai_family   = AF_UNSPEC;
+            hints.ai_socktype = SOCK_STREAM;
+            if ( getaddrinfo(host.c_str(), port.c_str(), &hints, &res) != 0 ) {
+                return -1;
+            }
+            int fd = -1;
+            for (auto ai = res; ai != nullptr and fd < 0; ai = ai->ai_next) {
+                fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+                if ( fd < 0 ) {
+                    continue;
+                }
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+                if ( connect(fd, ai->ai_addr, ai->ai_addrlen) != 0 and errno != EINPROGRESS ) {
+                    close(fd);
+                    fd = -1;
+                }
+            }
+            freeaddrinfo(res);
+            return fd;
+        }
+
+        // Check if buf holds a complete response. The server keeps the
+        // connection open after a chunked response, so the end of a
+        // chunked body is detected by its last chunk; closed tells if the
+        // server closed the connection.
+        // \returns 1 if the response is complete and body is set, 0 if
+        //          more data is needed and -1 on an error or another status
+        static int parse_response(const std::string& buf, bool closed, std::string& body) {
+            size_t header_end = buf.find("\r\n\r\n");
+            if ( header_end == std::string::npos ) {
+                return closed ? -1 : 0;
+            }
+            if ( buf.compare(0, 12, "HTTP/1.1 200") != 0 and buf.compare(0, 12, "HTTP/1.0 200") != 0 ) {
+                return -1;
+            }
+            if ( buf.substr(0, header_end).find("Transfer-Encoding: chunked") != std::string::npos ) {
+                if ( decode_chunked(buf, header_end+4, body) ) {
+                    return 1;
+                }
+                return closed ? -1 : 0;
+            }
+            if ( !closed ) {
+                return 0;
+            }
+            body = buf.substr(header_end+4);
+            return 1;
+        }
+
+        // Decode chunked body starting at pos of buf
+        // \returns false if the last chunk was not received yet
+        static bool decode_chunked(const std::string& buf, size_t pos, std::string& body) {
+            body.clear();
+            for (;;) {
+                size_t eol = buf.find("\r\n", pos);
+                if ( eol == std::string::npos ) {
+                    return false;
+                }
+                size_t len = std::strtoul(buf.c_str()+pos, nullptr, 16);
+                if ( len == 0 ) {
+                    return true;
+                }
+                if ( eol+2+len+2 > buf.size() ) {
+                    return false;
+                }
+                body.append(buf, eol+2, len);
+                pos = eol+2+len+2;
+            }
+        }
+};
+
+} // end namespace topkcomp
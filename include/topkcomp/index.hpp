@@ -5,7 +5,15 @@
 #include "index3.hpp"
 #include "index4.hpp"
 #include "index4ci.hpp"
+#include "index4u.hpp"
 #include "index5.hpp"
+#include "index5w.hpp"
+#include "index6.hpp"
+#include "index7.hpp"
+#include "index8.hpp"
+#include "lsm_index.hpp"
+#include "input_sort.hpp"
+#include "mmap_load.hpp"
 
 #include <string>
 #include <vector>
@@ -16,97 +24,66 @@
 
 namespace topkcomp{
 
+    // Input of an index constructor: indexes which read their input
+    // sequentially get the sorted input itself, the others the pairs as list
+    inline const sorted_input& index_input(sorted_input& input, std::true_type) {
+        return input;
+    }
+
+    inline tVPSU index_input(sorted_input& input, std::false_type) {
+        return input.release();
+    }
+
+    // Load index from index_file or generate it from file (and store it).
+    // The index file is mapped, see load_from_mapped_file.
+    // opt configures threads and memory budget used to sort the input
+    // \returns Construction time in seconds (0 if the index was loaded)
     template<typename t_index>
-    void
+    double
     generate_index_from_file(t_index& index,
                              const std::string& file,
                              const std::string& index_file,
-                             const std::string& index_name) 
+                             const std::string& index_name,
+                             const input_options& opt=input_options())
     {
         using namespace std;
         using namespace sdsl;
-        constexpr bool case_sensitive = t_index::case_sensitive;
+        typedef typename index_fold<t_index>::type t_fold;
         using clock = chrono::high_resolution_clock;
-        if ( load_from_file(index, index_file) ){
+        double construction_s = 0;
+        if ( load_from_mapped_file(index, index_file) ){
             cout << "Load index from "<<index_file << endl;
         } else {
             cout << "Index of " << file << " does not exists." << endl;
             cout << "Start generation" << endl;
-            ifstream in(file.c_str());
-            if ( !in ) {
+            if ( !ifstream(file.c_str()) ) {
                 cerr << "Error: Could not open file " << file << endl;
-                return;
-            }
-            tVPSU string_weight;
-            string entry;
-            while ( getline(in, entry, '\t')  ) {
-                string s_weight;
-                getline(in, s_weight);
-                uint64_t weight = stoull(s_weight);
-                string_weight.emplace_back(entry, weight);
+                return construction_s;
             }
-            if ( case_sensitive ) {
-                sort(string_weight.begin(), string_weight.end());
-            } else {
-                sort(string_weight.begin(), string_weight.end(),[](const tPSU& a, const tPSU& b){
-                    const uint8_t* ap = (const uint8_t*)(a.first.c_str());
-                    const uint8_t* bp = (const uint8_t*)(b.first.c_str());
-                    while ( std::tolower(*ap) == std::tolower(*bp) ) {
-                        if ( *ap == 0 ) {
-                            return false;
-                        } else {
-                            ++ap; ++bp;
-                        }
-                    }
-                    return std::tolower(*ap) < std::tolower(*bp);
-                });
-            }
-            cout << "Read and sorted " << string_weight.size() << " string." << endl;
-            if ( case_sensitive ) {
-                auto unique_end = unique(string_weight.begin(), string_weight.end(),
-                                         [](const tPSU& a, const tPSU& b) {
-                                            return a.first == b.first;
-                                         });
-                string_weight.resize(unique_end-string_weight.begin());
-            } else {
-                auto unique_end = unique(string_weight.begin(), string_weight.end(),
-                                         [](const tPSU& a, const tPSU& b) {
-                                            if ( a.first.size() != b.first.size() )
-                                                return false;
-                                            const uint8_t* ap = (const uint8_t*)(a.first.c_str());
-                                            const uint8_t* bp = (const uint8_t*)(b.first.c_str());
-                                            while ( std::tolower(*ap) == std::tolower(*bp) ) {
-                                                if ( *ap == 0 ) {
-                                                    return true;
-                                                } else {
-                                                    ++ap; ++bp;
-                                                }
-                                            }
-                                            return false;
-                                         });
-                string_weight.resize(unique_end-string_weight.begin());
-            }
-            cout << "Number of unique strings is " << string_weight.size() << "." << endl;
+            sorted_input input(file, t_fold(), opt);
+            cout << "Number of unique strings is " << input.size() << "." << endl;
 /*            {
                 ofstream out(file+".unique.txt");
-                for(size_t i=0; i<string_weight.size(); ++i){
-                    out << string_weight[i].first << "\t"<<string_weight[i].second << "\n";
-                }
+                input.for_each([&](size_t, const string& s, uint64_t w){
+                    out << s << "\t" << w << "\n";
+                });
             }
 */
             {
                 auto construction_start = clock::now();
-                t_index topk_index(string_weight);
+                t_index topk_index(index_input(input, std::is_constructible<t_index, const sorted_input&>()));
                 auto construction_time = clock::now() - construction_start;
                 auto construction_ms    = chrono::duration_cast<chrono::milliseconds>(construction_time).count();
-                cout << "Construction took "<< std::setprecision(3) << construction_ms / 1000.0;
+                construction_s = construction_ms / 1000.0;
+                cout << "Construction took "<< std::setprecision(3) << construction_s;
                 cout << " s" << endl;
                 store_to_file(topk_index, index_file);
                 write_structure<HTML_FORMAT>(topk_index, file+"."+index_name+".html");
                 cout << "Index size is " << size_in_mega_bytes(topk_index) << " MiB" << endl;
             }
-            load_from_file(index, index_file);
+            load_from_mapped_file(index, index_file);
         }
+        return construction_s;
     }
 
 } // end namespace
@@ -16,6 +16,7 @@ class index2 {
 
     public:
         typedef size_t size_type;
+        typedef range_cursor cursor_type;
         constexpr static bool case_sensitive = true;
 
         // Constructor takes a sorted list of (string,weight)-pairs
@@ -50,35 +51,47 @@ class index2 {
 
         // Return range [lb, rb) of matching strings
         t_range prefix_range(const std::string& prefix) const {
+            TOPKCOMP_STAGE_TIMER(prefix_range);
             t_range res = {{0, m_weight.size()}};
-            id_rac id(m_weight.size());
             for (size_t i=0; i<prefix.size(); ++i) {
-                // use binary search at each step to narrow the range
-                res[0] = std::lower_bound(id.begin()+res[0], id.begin()+res[1],
-                            prefix[i],  [&](size_t idx, char c){
-                                return m_text[m_start_sel(idx+1)+i] < c;
-                            }) - id.begin();
-                res[1] = std::upper_bound(id.begin()+res[0], id.begin()+res[1],
-                            prefix[i],  [&](char c, size_t idx){
-                                return c < m_text[m_start_sel(idx+1)+i];
-                            }) - id.begin();
+                res = narrow_range(res, prefix, i);
             }
             return res;
         }
 
+        // Return range [lb, rb) of matching strings. The search continues
+        // from the ranges of the previous prefix stored in the cursor.
+        t_range prefix_range(const std::string& prefix, cursor_type& cursor) const {
+            TOPKCOMP_STAGE_TIMER(prefix_range);
+            size_t i = cursor.resume(prefix);
+            if ( cursor.ranges.empty() ) {
+                cursor.ranges.push_back({{0, m_weight.size()}});
+            }
+            for (; i<prefix.size() and cursor.ranges.back()[0] < cursor.ranges.back()[1]; ++i) {
+                cursor.ranges.push_back(narrow_range(cursor.ranges.back(), prefix, i));
+            }
+            return cursor.ranges.back();
+        }
+
+
+        // Number of (string, weight)-pairs in the index
+        size_type size() const {
+            return m_weight.size();
+        }
 
         // k > 0
         tVPSU top_k(const std::string& prefix, size_t k) const {
-            auto range = prefix_range(prefix);
-            auto top_idx = heaviest_indexes_in_range(k, range, m_weight);
-            tVPSU result_list(top_idx.size());
-            for (size_t i=0; i < top_idx.size(); ++i){
-                auto idx = top_idx[i];
-                auto s = std::string(m_text.begin()+m_start_sel(idx+1), 
-                                     m_text.begin()+m_start_sel(idx+2));
-                result_list[i] = tPSU(s, m_weight[idx]);
-            }
-            return result_list; 
+            return top_k_in_range(prefix_range(prefix), k);
+        }
+
+        // k > 0; reuses the search state of the previous prefix
+        tVPSU top_k(const std::string& prefix, size_t k, cursor_type& cursor) const {
+            return top_k_in_range(prefix_range(prefix, cursor), k);
+        }
+
+        // Answer top-k queries for several prefixes at once
+        std::vector<tVPSU> top_k_batch(const std::vector<std::string>& prefixes, size_t k) const {
+            return topkcomp::top_k_batch(*this, prefixes, k);
         }
 
         // Serialize method (calls serialize method of each member)
@@ -105,6 +118,39 @@ class index2 {
             m_start_sel.set_vector(&m_start_bv); 
             m_weight.load(in);
         }
+
+    private:
+
+        // Narrow range res of strings prefixed by prefix[0..i-1] to the
+        // strings which are also matching prefix[i]
+        t_range narrow_range(t_range res, const std::string& prefix, size_t i) const {
+            id_rac id(m_weight.size());
+            // use binary search at each step to narrow the range
+            res[0] = std::lower_bound(id.begin()+res[0], id.begin()+res[1],
+                        prefix[i],  [&](size_t idx, char c){
+                            return m_text[m_start_sel(idx+1)+i] < c;
+                        }) - id.begin();
+            res[1] = std::upper_bound(id.begin()+res[0], id.begin()+res[1],
+                        prefix[i],  [&](char c, size_t idx){
+                            return c < m_text[m_start_sel(idx+1)+i];
+                        }) - id.begin();
+            return res;
+        }
+
+        // Get (string, weight)-pairs of the k heaviest strings in range
+        tVPSU top_k_in_range(t_range range, size_t k) const {
+            auto top_idx = heaviest_indexes_in_range(k, range, m_weight);
+            TOPKCOMP_STAGE_TIMER(label);
+            tVPSU result_list(top_idx.size());
+            for (size_t i=0; i < top_idx.size(); ++i){
+                auto idx = top_idx[i];
+                auto s = std::string(m_text.begin()+m_start_sel(idx+1), 
+                                     m_text.begin()+m_start_sel(idx+2));
+                result_list[i] = tPSU(s, m_weight[idx]);
+            }
+            return result_list; 
+        }
+
 };
 
 } // end namespace topkcomp
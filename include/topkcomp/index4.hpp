@@ -1,9 +1,15 @@
 #pragma once
 
 #include "index_common.hpp"
+#include "bp_trie.hpp"
+#include "input_sort.hpp"
+#include "topk_cache.hpp"
+#include "weight_overlay.hpp"
 #include <sdsl/bit_vectors.hpp>
 #include <sdsl/bp_support.hpp>
 #include <sdsl/rmq_support.hpp>
+#include <sdsl/wavelet_trees.hpp>
+#include <cmath>
 
 namespace topkcomp {
 
@@ -13,62 +19,220 @@ template<typename t_bv = sdsl::sd_vector<>,
          typename t_bp_support = sdsl::bp_support_sada<>,
          typename t_bp_rnk10 = sdsl::rank_support_v5<10,2>,
          typename t_bp_sel10 = sdsl::select_support_mcl<10,2>,
-         typename t_rmq = sdsl::rmq_succinct_sct<0>>
+         typename t_rmq = sdsl::rmq_succinct_sct<0>,
+         typename t_cache = topk_cache<>,
+         typename t_label = sdsl::int_vector<8>,
+         typename t_depth = sdsl::int_vector<>>
 class index4 {
-    typedef sdsl::int_vector<8> t_label;
-    typedef edge_rac<t_label>   t_edge_label;
-
-    t_label             m_labels;     // concatenation of tree labels
-    sdsl::bit_vector    m_bp;         // balanced parentheses sequence of tree
-    t_bp_support        m_bp_support; // support structure for m_bp
-    t_bp_rnk10          m_bp_rnk10;   // rank for leaf nodes in m_bp
-    t_bp_sel10          m_bp_sel10;   // select for leaf nodes in m_bp
-    t_bv                m_start_bv;   // marks start of labels in m_labels
-    t_sel               m_start_sel;  // select structure for m_start_bv
+    typedef bp_trie<t_bv, t_sel, t_bp_support, t_bp_rnk10, t_bp_sel10, t_label> t_trie;
+
+    t_trie              m_trie;       // trie of the strings
     t_rac_weight        m_weight;     // weights of strings 
     t_rmq               m_rmq;        // range maximum query on m_weight
+    t_depth             m_depth;      // string depth of each node in preorder
+    t_cache             m_cache;      // top-k lists of nodes with large sub trees
+    weight_overlay      m_overlay;    // updated weights; not serialized
 
 
     public:
         typedef size_t size_type;
+        constexpr static size_t npos = (size_t)-1;
+        typedef trie_cursor cursor_type;
         constexpr static bool case_sensitive = true;
 
         // Constructor takes a sorted list of (string,weight)-pairs
         index4(const tVPSU& string_weight=tVPSU()) {
-            using namespace sdsl;
-            if ( !string_weight.empty() ) {
-                uint64_t N, n, max_weight;
-                std::tie(N, n, max_weight) = input_stats(string_weight);
-                // initialize weight
-                {
-                    int_vector<> weight(N, 0, bits::hi(max_weight)+1);
-                    for (size_t i=0; i < N; ++i) {
-                        weight[i] = string_weight[i].second;
-                    }
-                    // initialize range maximum structure
-                    m_rmq = t_rmq(&weight);
-                    // intialize m_weight
-                    m_weight = t_rac_weight(weight);
+            build(string_weight);
+        }
+
+        // Constructor takes a sorted input which is read sequentially, so
+        // the pairs do not have to be in memory at once
+        index4(const sorted_input& string_weight) {
+            build(string_weight);
+        }
+ 
+        // Number of (string, weight)-pairs in the index
+        size_type size() const {
+            return m_weight.size();
+        }
+
+        // k > 0
+        tVPSU top_k(const std::string& prefix, size_t k) const {
+            result_arena arena;
+            top_k_at_node(find_node(prefix), k, arena);
+            return arena.to_vector();
+        }
+
+        // k > 0; reuses the search state of the previous prefix
+        tVPSU top_k(const std::string& prefix, size_t k, cursor_type& cursor) const {
+            result_arena arena;
+            top_k_at_node(find_node(prefix, cursor), k, arena);
+            return arena.to_vector();
+        }
+
+        // k > 0; decodes the results into the reusable buffers of arena
+        void top_k(const std::string& prefix, size_t k, result_arena& arena) const {
+            top_k_at_node(find_node(prefix), k, arena);
+        }
+
+        // k > 0; the strings whose indexes are in the sorted list skip
+        // are passed over by the rmq enumeration, e.g. strings which are
+        // shadowed by a newer tier of an lsm_index
+        tVPSU top_k(const std::string& prefix, size_t k, const tVU& skip) const {
+            result_arena arena;
+            size_t v = find_node(prefix);
+            if ( v != npos ) {
+                auto ov = m_overlay.snapshot();
+                tVU top_idx = ov->heaviest_indexes_in_ranges(k, std::vector<t_range>{node_range(v)}, m_weight, m_rmq,
+                                  [](uint64_t w, size_t){ return w; },
+                                  [&](size_t idx){ return std::binary_search(skip.begin(), skip.end(), idx); });
+                decode(top_idx, arena);
+                for (size_t i=0; i < top_idx.size(); ++i) {
+                    arena.weight[i] = ov->weight(top_idx[i], m_weight);
                 }
-                // build the succinct tree
-                build_tree(string_weight, N, n);
-                // initialize the support structures
-                m_start_sel  = t_sel(&m_start_bv);
-                m_bp_support = t_bp_support(&m_bp);
-                m_bp_rnk10   = t_bp_rnk10(&m_bp);
-                m_bp_sel10   = t_bp_sel10(&m_bp);
             }
+            return arena.to_vector();
         }
- 
+
+        // k > 0; calls out(string, weight) for the results in order of
+        // decreasing weight. Each string is decoded as soon as the RMQ
+        // enumeration selects it, so the first results can be sent while
+        // the others are computed.
+        template<class t_out>
+        void top_k_stream(const std::string& prefix, size_t k, cursor_type& cursor, t_out out) const {
+            size_t v = find_node(prefix, cursor);
+            if ( v == npos ) {
+                return;
+            }
+            // precomputed lists and lists with updated weights are complete at once
+            if ( !m_overlay.snapshot()->empty() or m_cache.find(node_id(v), k) > 0 ) {
+                result_arena arena;
+                top_k_at_node(v, k, arena);
+                for (size_t i=0; i < arena.size(); ++i) {
+                    out(arena.str(i), arena.weight[i]);
+                }
+                return;
+            }
+            TOPKCOMP_STAGE_TIMER_PAUSED(label); // runs while the strings are decoded
+            for_each_heaviest_index(k, node_range(v), m_weight, m_rmq, [&](size_t idx){
+                TOPKCOMP_STAGE_RESUME(label);
+                std::string str = label(idx);
+                TOPKCOMP_STAGE_PAUSE(label);
+                out(str, (uint64_t)m_weight[idx]);
+            });
+        }
+
+        // Typo tolerant top-k: strings which start with a string of edit
+        // distance at most max_edits to prefix. A string matched with e
+        // edits is ranked by weight/penalty^e; reported are the weights.
         // k > 0
-        tVPSU top_k(const std::string& prefix, size_t k) const{
-            auto range = prefix_range(prefix);
-            auto top_idx = heaviest_indexes_in_range(k, range, m_weight, m_rmq);
-            tVPSU result_list;
-            for (auto idx : top_idx){
-                result_list.push_back(tPSU(label(idx), m_weight[idx]));
+        tVPSU top_k_fuzzy(const std::string& prefix, size_t k, size_t max_edits,
+                          double penalty=2.0) const {
+            auto ov = m_overlay.snapshot();
+            std::vector<t_range> ranges;
+            std::vector<double>  factor; // penalty^e of the ranges
+            for (const auto& r : fuzzy_ranges(prefix, max_edits)) {
+                ranges.push_back(r.first);
+                factor.push_back(std::pow(penalty, (double)r.second));
+            }
+            tVU top_idx = ov->heaviest_indexes_in_ranges(k, ranges, m_weight, m_rmq,
+                              [&](uint64_t w, size_t i){ return w / factor[i]; });
+            result_arena arena;
+            decode(top_idx, arena);
+            for (size_t i=0; i < top_idx.size(); ++i) {
+                arena.weight[i] = ov->weight(top_idx[i], m_weight);
+            }
+            return arena.to_vector();
+        }
+
+        // Index of string s or npos if s is not contained
+        size_t find_string(const std::string& s) const {
+            size_t v = find_node(s);
+            if ( v == npos )
+                return npos;
+            // s is the smallest string in the sub tree if it is contained;
+            // all strings in the sub tree start with s
+            size_t idx = node_range(v)[0];
+            return depth(node_id(m_trie.leaf(idx))) == s.size() ? idx : npos;
+        }
+
+        // Set the weights of strings to new values without rebuilding the
+        // index. Strings which are not contained are ignored. Queries see
+        // the new weights at once; they are kept in an overlay until
+        // compact() is called.
+        // \returns Number of updated strings
+        size_t update_weights(const tVPSU& string_weight) {
+            std::vector<tPUU> updates;
+            for (const auto& sw : string_weight) {
+                size_t idx = find_string(sw.first);
+                if ( idx != npos ) {
+                    updates.emplace_back(idx, sw.second);
+                }
             }
-            return result_list;
+            update_weights(updates);
+            return updates.size();
+        }
+
+        // Set the weights of (index, weight)-pairs
+        void update_weights(const std::vector<tPUU>& idx_weight) {
+            m_overlay.apply(idx_weight);
+        }
+
+        // (index, weight)-pairs of the updates which are not compacted
+        std::vector<tPUU> updated_weights() const {
+            return m_overlay.snapshot()->entries();
+        }
+
+        // Merge the updated weights into the static weight structures.
+        // Must not run concurrently with queries or updates.
+        void compact() {
+            auto ov = m_overlay.snapshot();
+            if ( ov->empty() )
+                return;
+            sdsl::int_vector<> weight(m_weight.size(), 0);
+            for (size_t i=0; i < m_weight.size(); ++i) {
+                weight[i] = m_weight[i];
+            }
+            for (const auto& e : ov->entries()) {
+                weight[e.first] = e.second;
+            }
+            sdsl::util::bit_compress(weight);
+            m_rmq    = t_rmq(&weight);
+            m_weight = t_rac_weight(weight);
+            build_cache();
+            m_overlay.clear();
+        }
+
+        // Answer top-k queries for several prefixes at once. The prefixes
+        // are searched in sorted order with one cursor, and the RMQ
+        // enumeration of a prefix continues the one of the longest prefix
+        // of the batch it extends (see heaviest_indexes_in_nested_ranges).
+        std::vector<tVPSU> top_k_batch(const std::vector<std::string>& prefixes, size_t k) const {
+            if ( !m_overlay.snapshot()->empty() ) {
+                return topkcomp::top_k_batch(*this, prefixes, k);
+            }
+            std::vector<size_t> order = sorted_order(prefixes);
+            std::vector<tVPSU> res(prefixes.size());
+            std::vector<t_range> ranges(order.size(), t_range{{0, 0}});
+            result_arena arena;
+            cursor_type cursor;
+            for (size_t j=0; j < order.size(); ++j) {
+                size_t v = find_node(prefixes[order[j]], cursor);
+                if ( v != npos and m_cache.find(node_id(v), k) > 0 ) {
+                    top_k_at_node(v, k, arena); // precomputed list
+                    res[order[j]] = arena.to_vector();
+                } else if ( v != npos ) {
+                    ranges[j] = node_range(v);
+                }
+            }
+            auto top_idx = heaviest_indexes_in_nested_ranges(k, ranges, m_weight, m_rmq);
+            for (size_t j=0; j < order.size(); ++j) {
+                if ( ranges[j][0] < ranges[j][1] ) {
+                    decode(top_idx[j], arena);
+                    res[order[j]] = arena.to_vector();
+                }
+            }
+            return res;
         }
 
         // Serialize method (calls serialize method of each member)
@@ -78,190 +242,217 @@ class index4 {
             using namespace sdsl;
             auto child = structure_tree::add_child(v, name, util::class_name(*this));
             size_type written_bytes = 0;
-            written_bytes += m_labels.serialize(out, child, "labels");
-            written_bytes += m_bp.serialize(out, child, "bp");
-            written_bytes += m_bp_support.serialize(out, child, "bp_support");
-            written_bytes += m_bp_rnk10.serialize(out, child, "bp_rnk10");
-            written_bytes += m_bp_sel10.serialize(out, child, "bp_sel10");
-            written_bytes += m_start_bv.serialize(out, child, "start_bv");
-            written_bytes += m_start_sel.serialize(out, child, "start_sel");
+            written_bytes += m_trie.serialize(out, child, "trie");
             written_bytes += m_weight.serialize(out, child, "weight");
             written_bytes += m_rmq.serialize(out, child, "rmq");
+            written_bytes += m_depth.serialize(out, child, "depth");
+            written_bytes += m_cache.serialize(out, child, "cache");
             structure_tree::add_size(child, written_bytes);
             return written_bytes;
         }
 
         // Load method (calls load method of each member)
         void load(std::istream& in) {
-            m_labels.load(in);
-            m_bp.load(in);
-            m_bp_support.load(in, &m_bp);
-            m_bp_support.set_vector(&m_bp);
-            m_bp_rnk10.load(in);
-            m_bp_rnk10.set_vector(&m_bp);
-            m_bp_sel10.load(in);
-            m_bp_sel10.set_vector(&m_bp);
-            m_start_bv.load(in);
-            m_start_sel.load(in);
-            m_start_sel.set_vector(&m_start_bv);
+            m_trie.load(in);
             m_weight.load(in);
             m_rmq.load(in);
+            m_depth.load(in);
+            m_cache.load(in);
         }
 
     private:
 
-        // Build balanced parentheses sequence of the trie of the strings
-        void build_tree(const tVPSU& string_weight, size_t N, size_t n) {
+        // Build the index from an input of (string,weight)-pairs (see
+        // for_each_pair)
+        template<typename t_input>
+        void build(const t_input& string_weight) {
             using namespace sdsl;
-            bit_vector start_bv(2*N+n+2, 0);   // initialize to worst case size
-            m_labels   = int_vector<8>(n);     // initialize to worst case size
-            m_bp       = bit_vector(2*2*N, 0); // initialize to worst case size
-
-
-            auto bp_it    = m_bp.begin();
-            auto start_it = start_bv.begin();
-            auto label_it = m_labels.begin();
-            *(start_it++) = 1;                // mark start of first label 
-            build_tree(string_weight, 0, N, 0, bp_it, start_it, label_it);
-            m_bp.resize(bp_it-m_bp.begin());            // resize to actual size
-            m_labels.resize(label_it-m_labels.begin()); // resize to actual size
-            start_bv.resize(start_it-start_bv.begin()); // resize to actual size
-
-            m_start_bv = t_bv(start_bv);     // copy to member bitvector
+            if ( !string_weight.empty() ) {
+                // build the succinct tree
+                m_trie = t_trie(string_weight, no_fold());
+                // initialize weight
+                {
+                    auto weight = weight_vector(string_weight);
+                    // initialize range maximum structure
+                    m_rmq = t_rmq(&weight);
+                    // intialize m_weight
+                    m_weight = t_rac_weight(weight);
+                }
+                m_depth = t_depth(m_trie.string_depths());
+                // precompute top-k lists of the upper part of the trie
+                build_cache();
+            }
         }
 
-        // Recursive tree construction
-        void
-        build_tree(const tVPSU& string_weight, size_t lb, size_t rb, size_t depth,
-                   sdsl::bit_vector::iterator& bp_it,
-                   sdsl::bit_vector::iterator& start_it,
-                   sdsl::int_vector<8>::iterator& label_it) 
-        {
-            if ( lb >= rb )
+        // Decode the k heaviest strings in the sub tree of node v into
+        // arena; v = npos represents an empty sub tree
+        void top_k_at_node(size_t v, size_t k, result_arena& arena) const {
+            arena.clear();
+            if ( v == npos ) {
                 return;
-            *(bp_it++) = 1; // append ,,(''
-            size_t d = depth;
-            const uint8_t* lb_entry = (const uint8_t*)(string_weight[lb].first.c_str());
-            const uint8_t* rb_entry = (const uint8_t*)(string_weight[rb-1].first.c_str());
-            // extend common prefix
-            while ( lb_entry[d] !=0 and lb_entry[d] == rb_entry[d] ) {
-                *(label_it++) = lb_entry[d]; // store common char
-                ++start_it; ++d;
             }
-            *(start_it++) = 1; // mark end of edge label
-            // if node is not a leaf
-            if ( lb+1 < rb) {
-                // handle children
-                while ( lb < rb ) {
-                    uint8_t c = string_weight[lb].first.c_str()[d];
-                    size_t mid = lb+1;
-                    while ( mid < rb and ((uint8_t)string_weight[mid].first.c_str()[d]) == c ) {
-                        ++mid;
+            tVU top_idx;
+            auto ov = m_overlay.snapshot();
+            // precomputed lists do not reflect updated weights
+            size_t s = ov->empty() ? m_cache.find(node_id(v), k) : 0;
+            if ( s > 0 ) { // precomputed list
+                TOPKCOMP_COUNT(cache_hits);
+                if ( m_cache.has_labels() ) {
+                    for (size_t i=0; i < k; ++i) {
+                        size_t begin = arena.text.size();
+                        m_cache.append_label(s, i, arena.text);
+                        arena.pos.emplace_back(begin, arena.text.size()-begin);
+                        arena.weight.push_back(m_weight[m_cache.id(s, i)]);
                     }
-                    build_tree(string_weight, lb, mid, d, bp_it, start_it, label_it);
-                    lb = mid;
+                    return;
+                }
+                for (size_t i=0; i < k; ++i) {
+                    top_idx.push_back(m_cache.id(s, i));
                 }
+            } else if ( ov->empty() ) {
+                top_idx = heaviest_indexes_in_range(k, node_range(v), m_weight, m_rmq);
+            } else {
+                top_idx = ov->heaviest_indexes_in_range(k, node_range(v), m_weight, m_rmq);
             }
-            bp_it++; // move iterator to right; e.g. append ,,)''
+            decode(top_idx, arena);
+            if ( !ov->empty() ) {
+                for (size_t i=0; i < top_idx.size(); ++i) {
+                    arena.weight[i] = ov->weight(top_idx[i], m_weight);
+                }
+            }
+        }
+
+        // Decode the strings at indexes top_idx into arena, in the order of top_idx
+        void decode(const tVU& top_idx, result_arena& arena) const {
+            m_trie.decode(top_idx, m_weight, m_depth, arena);
         }
 
-       // Return range [lb, rb) of matching strings
-        std::array<size_t,2> prefix_range(const std::string& prefix) const {
-            size_t v = 0; // node is represented by position of opening parenthesis in bp
-            size_t m = 0; // length of common prefix
-            while ( m < prefix.size() ) {
-                auto cv = children(v);
-                if ( cv.size() == 0 ) { // v is already a leaf, prefix is longer than leaf
-                    return {{0,0}};
+        // Ranges of the strings which start with a string of edit distance
+        // at most max_edits to prefix, each paired with the minimal distance.
+        // The trie is traversed depth-first with one row of the Levenshtein
+        // matrix per position; a sub tree is left as soon as no row entry
+        // is below the best distance found on the path, so only positions
+        // within distance max_edits of a prefix of prefix are visited.
+        // \returns Disjoint ranges in increasing order
+        std::vector<std::pair<t_range, size_t>>
+        fuzzy_ranges(const std::string& prefix, size_t max_edits) const {
+            TOPKCOMP_STAGE_TIMER(prefix_range);
+            const size_t m = prefix.size();
+            std::vector<tTUUU> matches; // (lb, rb, edits) of matched sub trees in preorder
+            struct state {
+                size_t v;
+                size_t best; // smallest distance matched on the path to v
+                tVU    row;  // row of the matrix at the start of the edge to v
+            };
+            tVU first_row(m+1);
+            std::iota(first_row.begin(), first_row.end(), 0);
+            std::vector<state> stack;
+            stack.push_back({0, max_edits+1, first_row});
+            while ( !stack.empty() ) {
+                state s = std::move(stack.back());
+                stack.pop_back();
+                size_t best = s.best;
+                tVU& row = s.row;
+                // a match ends at this position if row[m] improves best;
+                // the search goes on while some entry is below best
+                auto step = [&]() {
+                    best = std::min(best, row[m]);
+                    return *std::min_element(row.begin(), row.end()) < best;
+                };
+                bool alive = s.v != 0 or step(); // positions before the root edge
+                auto e = m_trie.edge(node_id(s.v));
+                for (size_t i=0; alive and i < e.size(); ++i) {
+                    uint8_t c = e[i];
+                    size_t diag = row[0];
+                    row[0] += 1;
+                    for (size_t j=1; j <= m; ++j) {
+                        size_t up = row[j];
+                        row[j] = std::min({diag + (((uint8_t)prefix[j-1]) != c), up+1, row[j-1]+1});
+                        diag = up;
+                    }
+                    alive = step();
                 }
-                auto w = v;
-                auto w_edge = edge(node_id(cv[0]));
-                size_t i = 0;
-                while ( ++i < cv.size() and w_edge[0] < ((uint8_t)prefix[m]) ) {
-                    w_edge = edge(node_id(cv[i]));
+                if ( best < s.best ) {
+                    auto r = node_range(s.v);
+                    matches.emplace_back(r[0], r[1], best);
                 }
-                if ( ((uint8_t)prefix[m]) != w_edge[0] ) { // no matching child found
-                    return {{0,0}};
-                } else {
-                    w = cv[i-1];
-                    size_t mm = m+1;
-                    while ( mm < prefix.size() and mm-m < w_edge.size() and  (uint8_t)prefix[mm] == w_edge[mm-m] ) {
-                        ++mm;
-                    }
-                    // edge search exhausted 
-                    if ( mm-m == w_edge.size() ){
-                        v = w;
-                        m = mm;
-                    } else { // edge search not exhausted
-                        if ( mm == prefix.size() ) { // pattern exhausted
-                            v = w;
-                            m = mm;
-                        } else { // pattern not exhausted -> mismatch
-                            return {{0,0}};
-                        }
+                if ( alive ) {
+                    auto cv = m_trie.children(s.v);
+                    for (size_t i=cv.size(); i > 0; --i) {
+                        stack.push_back({cv[i-1], best, row});
                     }
                 }
             }
-            // Map from sub tree rooted at v to strings in the original array
-            return {{m_bp_rnk10(v), m_bp_rnk10(m_bp_support.find_close(v)+1)}};
+            // matches are nested; split them into disjoint ranges, where an
+            // inner range has a smaller distance than the enclosing ones
+            std::vector<std::pair<t_range, size_t>> ranges;
+            auto add = [&](size_t lb, size_t rb, size_t edits) {
+                if ( lb < rb ) ranges.push_back({{{lb, rb}}, edits});
+            };
+            std::vector<tTUUU> open;
+            size_t pos = 0;
+            for (const auto& mt : matches) {
+                while ( !open.empty() and std::get<1>(open.back()) <= std::get<0>(mt) ) {
+                    add(pos, std::get<1>(open.back()), std::get<2>(open.back()));
+                    pos = std::get<1>(open.back());
+                    open.pop_back();
+                }
+                if ( !open.empty() ) {
+                    add(pos, std::get<0>(mt), std::get<2>(open.back()));
+                }
+                pos = std::get<0>(mt);
+                open.push_back(mt);
+            }
+            while ( !open.empty() ) {
+                add(pos, std::get<1>(open.back()), std::get<2>(open.back()));
+                pos = std::max(pos, std::get<1>(open.back()));
+                open.pop_back();
+            }
+            return ranges;
         }
 
-       // Map node v to its unique identifier. node_id : v -> [1..N]
-        size_t node_id(size_t v) const{
-            return m_bp_support.rank(v);
+        // Store the top-k lists of all nodes with large sub trees
+        void build_cache() {
+            m_cache = m_trie.template build_cache<t_cache>(
+                          [&](t_range r) {
+                              return heaviest_indexes_in_range(t_cache::max_k(), r, m_weight, m_rmq);
+                          },
+                          [&](size_t idx) { return label(idx); });
         }
 
-        // Get edge label leading to node v with node_id(v) = v_id
-        t_edge_label edge(size_t v_id) const{
-            size_t begin = m_start_sel(v_id) + 1 - v_id;
-            size_t end   = m_start_sel(v_id+1) + 1 - (v_id+1);
-            return t_edge_label(&m_labels, begin, end);
+        // Return the node whose sub tree holds the strings matching prefix
+        // or npos if there is no matching string
+        size_t find_node(const std::string& prefix) const {
+            return m_trie.find_node(prefix);
         }
 
-        // Check if v is a leaf
-        size_t is_leaf(size_t v) const {
-            return m_bp[v+1] == 0;
+        // Return the node whose sub tree holds the strings matching prefix
+        // or npos. The search continues from the state of the previous
+        // prefix stored in the cursor.
+        size_t find_node(const std::string& prefix, cursor_type& cursor) const {
+            return m_trie.find_node(prefix, &cursor);
         }
 
-        // Check if v is the root node
-        size_type is_root(size_t v) const {
-            return v == 0;
+        // Map from sub tree rooted at v to strings in the original array
+        t_range node_range(size_t v) const {
+            return m_trie.node_range(v);
         }
 
-        // Return parent of v
-        size_type parent(size_t v) const {
-            return m_bp_support.enclose(v);
+       // Map node v to its unique identifier. node_id : v -> [1..N]
+        size_t node_id(size_t v) const{
+            return m_trie.node_id(v);
         }
 
-        // Reconstruct label at position idx of original sequence
-        std::string label(size_t idx) const {
-            std::stack<size_t> node_stack;
-            node_stack.push(m_bp_sel10(idx+1)-1);
-            while ( !is_root(node_stack.top()) ) {
-                size_t p = parent(node_stack.top());
-                node_stack.push(p);
-            }
-            std::string res;
-            while ( !node_stack.empty() ){
-                auto e = edge(node_id(node_stack.top()));
-                res.append(e.begin(), e.end());
-                node_stack.pop();
-            }
-            return res;
+        // String depth of node v with node_id(v) = v_id
+        size_t depth(size_t v_id) const {
+            return m_depth[v_id-1];
         }
 
-        // Return all children of v
-        std::vector<size_t> children(size_t v) const {
-            std::vector<size_t> res;
-            size_t cv = v+1;
-            while ( m_bp[cv] ) {
-                res.push_back(cv);
-                cv = m_bp_support.find_close(cv) + 1;
-            }
-            return res;
+        // Reconstruct label at position idx of original sequence
+        std::string label(size_t idx) const {
+            return m_trie.label(idx, m_depth);
         }
 
-
 };
 
 } // end namespace topkcomp
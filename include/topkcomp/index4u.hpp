@@ -0,0 +1,268 @@
+#pragma once
+
+#include "index_common.hpp"
+#include "bp_trie.hpp"
+#include "input_sort.hpp"
+#include "case_fold.hpp"
+#include "spelling_exceptions.hpp"
+#include "topk_cache.hpp"
+#include <sdsl/bit_vectors.hpp>
+#include <sdsl/bp_support.hpp>
+#include <sdsl/rmq_support.hpp>
+
+namespace topkcomp {
+
+// Case insensitive trie index. The trie stores the keys of the strings
+// under the fold t_fold, by default Unicode simple case folding of UTF-8
+// strings; utf8_fold<true> also removes accents and ascii_fold only folds
+// ASCII letters (index4ci). The original spellings are kept as sparse
+// exceptions to the keys.
+template<typename t_fold = utf8_fold<>,
+         typename t_bv = sdsl::sd_vector<>,
+         typename t_sel= typename t_bv::select_1_type,
+         typename t_rac_weight = sdsl::int_vector<>,
+         typename t_bp_support = sdsl::bp_support_sada<>,
+         typename t_bp_rnk10 = sdsl::rank_support_v5<10,2>,
+         typename t_bp_sel10 = sdsl::select_support_mcl<10,2>,
+         typename t_rmq = sdsl::rmq_succinct_sct<0>,
+         typename t_exc = spelling_exceptions<>,
+         typename t_cache = topk_cache<>,
+         typename t_label = sdsl::int_vector<8>
+         >
+class index4u {
+    typedef bp_trie<t_bv, t_sel, t_bp_support, t_bp_rnk10, t_bp_sel10, t_label> t_trie;
+
+    t_trie              m_trie;        // trie of the keys of the strings
+    t_rac_weight        m_weight;      // weights of strings 
+    t_rmq               m_rmq;         // range maximum query on m_weight
+    t_exc               m_exc;         // original spellings of the strings
+    t_cache             m_cache;       // top-k lists of nodes with large sub trees
+
+    public:
+        typedef size_t size_type;
+        constexpr static size_t npos = (size_t)-1;
+        typedef trie_cursor cursor_type;
+        constexpr static bool case_sensitive = false;
+        typedef t_fold fold_type;
+
+        // Constructor takes a list of (string,weight)-pairs sorted by key
+        index4u(const tVPSU& string_weight=tVPSU()) {
+            build(string_weight);
+        }
+
+        // Constructor takes a sorted input which is read sequentially, so
+        // the pairs do not have to be in memory at once
+        index4u(const sorted_input& string_weight) {
+            build(string_weight);
+        }
+ 
+        // Number of (string, weight)-pairs in the index
+        size_type size() const {
+            return m_weight.size();
+        }
+
+        // k > 0
+        tVPSU top_k(const std::string& prefix, size_t k) const {
+            result_arena arena;
+            top_k_at_node(find_node(prefix), k, arena);
+            return arena.to_vector();
+        }
+
+        // k > 0; reuses the search state of the previous prefix
+        tVPSU top_k(const std::string& prefix, size_t k, cursor_type& cursor) const {
+            result_arena arena;
+            top_k_at_node(find_node(prefix, cursor), k, arena);
+            return arena.to_vector();
+        }
+
+        // k > 0; decodes the results into the reusable buffers of arena
+        void top_k(const std::string& prefix, size_t k, result_arena& arena) const {
+            top_k_at_node(find_node(prefix), k, arena);
+        }
+
+        // k > 0; calls out(string, weight) for the results in order of
+        // decreasing weight. Each string is decoded as soon as the RMQ
+        // enumeration selects it, so the first results can be sent while
+        // the others are computed.
+        template<class t_out>
+        void top_k_stream(const std::string& prefix, size_t k, cursor_type& cursor, t_out out) const {
+            size_t v = find_node(prefix, cursor);
+            if ( v == npos ) {
+                return;
+            }
+            // precomputed lists are complete at once
+            if ( m_cache.find(node_id(v), k) > 0 ) {
+                result_arena arena;
+                top_k_at_node(v, k, arena);
+                for (size_t i=0; i < arena.size(); ++i) {
+                    out(arena.str(i), arena.weight[i]);
+                }
+                return;
+            }
+            TOPKCOMP_STAGE_TIMER_PAUSED(label); // runs while the strings are decoded
+            for_each_heaviest_index(k, node_range(v), m_weight, m_rmq, [&](size_t idx){
+                TOPKCOMP_STAGE_RESUME(label);
+                std::string str = label(idx);
+                TOPKCOMP_STAGE_PAUSE(label);
+                out(str, (uint64_t)m_weight[idx]);
+            });
+        }
+
+        // Answer top-k queries for several prefixes at once. The prefixes
+        // are searched in sorted order with one cursor, and the RMQ
+        // enumeration of a prefix continues the one of the longest prefix
+        // of the batch it extends (see heaviest_indexes_in_nested_ranges).
+        std::vector<tVPSU> top_k_batch(const std::vector<std::string>& prefixes, size_t k) const {
+            std::vector<size_t> order = sorted_order(prefixes);
+            std::vector<tVPSU> res(prefixes.size());
+            std::vector<t_range> ranges(order.size(), t_range{{0, 0}});
+            result_arena arena;
+            cursor_type cursor;
+            for (size_t j=0; j < order.size(); ++j) {
+                size_t v = find_node(prefixes[order[j]], cursor);
+                if ( v != npos and m_cache.find(node_id(v), k) > 0 ) {
+                    top_k_at_node(v, k, arena); // precomputed list
+                    res[order[j]] = arena.to_vector();
+                } else if ( v != npos ) {
+                    ranges[j] = node_range(v);
+                }
+            }
+            auto top_idx = heaviest_indexes_in_nested_ranges(k, ranges, m_weight, m_rmq);
+            for (size_t j=0; j < order.size(); ++j) {
+                if ( ranges[j][0] < ranges[j][1] ) {
+                    decode(top_idx[j], arena);
+                    res[order[j]] = arena.to_vector();
+                }
+            }
+            return res;
+        }
+
+        // Serialize method (calls serialize method of each member)
+        size_type
+        serialize(std::ostream& out, sdsl::structure_tree_node* v=nullptr,
+                  std::string name="") const {
+            using namespace sdsl;
+            auto child = structure_tree::add_child(v, name, util::class_name(*this));
+            size_type written_bytes = 0;
+            written_bytes += m_trie.serialize(out, child, "trie");
+            written_bytes += m_weight.serialize(out, child, "weight");
+            written_bytes += m_rmq.serialize(out, child, "rmq");
+            written_bytes += m_exc.serialize(out, child, "exc");
+            written_bytes += m_cache.serialize(out, child, "cache");
+            structure_tree::add_size(child, written_bytes);
+            return written_bytes;
+        }
+
+        // Load method (calls load method of each member)
+        void load(std::istream& in) {
+            m_trie.load(in);
+            m_weight.load(in);
+            m_rmq.load(in);
+            m_exc.load(in);
+            m_cache.load(in);
+        }
+
+    private:
+
+        // Build the index from an input of (string,weight)-pairs (see
+        // for_each_pair)
+        template<typename t_input>
+        void build(const t_input& string_weight) {
+            using namespace sdsl;
+            if ( !string_weight.empty() ) {
+                // initialize weight
+                {
+                    auto weight = weight_vector(string_weight);
+                    // initialize range maximum structure
+                    m_rmq = t_rmq(&weight);
+                    // intialize m_weight
+                    m_weight = t_rac_weight(weight);
+                }
+                m_exc = t_exc(string_weight, t_fold());
+                // build the succinct tree over the keys of the strings
+                m_trie = t_trie(string_weight, t_fold());
+                // precompute top-k lists of the upper part of the trie
+                build_cache();
+            }
+        }
+
+        // Decode the k heaviest strings in the sub tree of node v into
+        // arena; v = npos represents an empty sub tree
+        void top_k_at_node(size_t v, size_t k, result_arena& arena) const {
+            arena.clear();
+            if ( v == npos ) {
+                return;
+            }
+            tVU top_idx;
+            size_t s = m_cache.find(node_id(v), k);
+            if ( s > 0 ) { // precomputed list
+                TOPKCOMP_COUNT(cache_hits);
+                if ( m_cache.has_labels() ) {
+                    for (size_t i=0; i < k; ++i) {
+                        size_t begin = arena.text.size();
+                        m_cache.append_label(s, i, arena.text);
+                        arena.pos.emplace_back(begin, arena.text.size()-begin);
+                        arena.weight.push_back(m_weight[m_cache.id(s, i)]);
+                    }
+                    return;
+                }
+                for (size_t i=0; i < k; ++i) {
+                    top_idx.push_back(m_cache.id(s, i));
+                }
+            } else {
+                top_idx = heaviest_indexes_in_range(k, node_range(v), m_weight, m_rmq);
+            }
+            decode(top_idx, arena);
+        }
+
+        // Decode the strings at indexes top_idx into arena, in the order of
+        // top_idx; the decoded keys are mapped to the original spellings
+        void decode(const tVU& top_idx, result_arena& arena) const {
+            m_trie.decode(top_idx, m_weight, arena, [this](size_t idx, const std::string& key, std::string& text) {
+                m_exc.restore(idx, key.data(), key.size(), text);
+            });
+        }
+
+        // Store the top-k lists of all nodes with large sub trees
+        void build_cache() {
+            m_cache = m_trie.template build_cache<t_cache>(
+                          [&](t_range r) {
+                              return heaviest_indexes_in_range(t_cache::max_k(), r, m_weight, m_rmq);
+                          },
+                          [&](size_t idx) { return label(idx); });
+        }
+
+        // Return the node whose sub tree holds the strings matching prefix
+        // or npos if there is no matching string
+        size_t find_node(const std::string& prefix) const {
+            return m_trie.find_node(t_fold::key(prefix));
+        }
+
+        // Return the node whose sub tree holds the strings matching prefix
+        // or npos. The search continues from the state of the previous
+        // prefix stored in the cursor.
+        size_t find_node(const std::string& org_prefix, cursor_type& cursor) const {
+            return m_trie.find_node(t_fold::key(org_prefix), &cursor);
+        }
+
+        // Map from sub tree rooted at v to strings in the original array
+        t_range node_range(size_t v) const {
+            return m_trie.node_range(v);
+        }
+
+       // Map node v to its unique identifier. node_id : v -> [1..N]
+        size_t node_id(size_t v) const{
+            return m_trie.node_id(v);
+        }
+
+        // Reconstruct label at position idx of original sequence
+        std::string label(size_t idx) const {
+            std::string key = m_trie.label(idx);
+            // key -> original spelling
+            std::string org;
+            m_exc.restore(idx, key.data(), key.size(), org);
+            return org;
+        }
+};
+
+} // end namespace topkcomp
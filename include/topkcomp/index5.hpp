@@ -1,6 +1,7 @@
 #pragma once
 
 #include "index_common.hpp"
+#include "weight_overlay.hpp"
 #include <sdsl/suffix_arrays.hpp>
 #include <sdsl/bp_support.hpp>
 #include <sdsl/rmq_support.hpp>
@@ -23,9 +24,12 @@ class index5 {
     t_sel              m_start_sel; // select support structure for m_start
     t_rac_weight       m_weight;    // weights of strings
     t_rmq              m_rmq;       // range maximum query on m_weight
+    weight_overlay     m_overlay;   // updated weights; not serialized
 
     public:
         typedef size_t size_type;
+        constexpr static size_t npos = (size_t)-1;
+        typedef no_cursor cursor_type;
         constexpr static bool case_sensitive = true;
 
         // Constructor takes a sorted list of (string,weight)-pairs
@@ -78,15 +82,86 @@ class index5 {
             }
         }
 
+        // Number of (string, weight)-pairs in the index
+        size_type size() const {
+            return m_weight.size();
+        }
+
         // k > 0
-        tVPSU top_k(const std::string& prefix, size_t k) const{
-            auto range = prefix_range(prefix);
-            auto top_idx = heaviest_indexes_in_range(k, range, m_weight, m_rmq);
-            tVPSU result_list;
-            for (auto idx : top_idx){
-                result_list.push_back(tPSU(label(idx), m_weight[idx]));
+        tVPSU top_k(const std::string& prefix, size_t k) const {
+            return top_k_in_range(prefix_range(prefix), k);
+        }
+
+        // k > 0; the CSA search can not be resumed, so the cursor is unused
+        tVPSU top_k(const std::string& prefix, size_t k, cursor_type&) const {
+            return top_k(prefix, k);
+        }
+
+        // Index of string s or npos if s is not contained
+        size_t find_string(const std::string& s) const {
+            auto r = prefix_range(s);
+            for (size_t idx=r[0]; idx < r[1]; ++idx) {
+                // s is a prefix of the string at idx; check that it ends after |s|
+                size_t sa_pos = m_start_sel(idx+1);
+                for (size_t i=0; i < s.size(); ++i) {
+                    sa_pos = m_csa.psi[sa_pos];
+                }
+                if ( m_start[sa_pos] or sdsl::first_row_symbol(sa_pos, m_csa) == 0 ) {
+                    return idx;
+                }
             }
-            return result_list;
+            return npos;
+        }
+
+        // Set the weights of strings to new values without rebuilding the
+        // index. Strings which are not contained are ignored. Queries see
+        // the new weights at once; they are kept in an overlay until
+        // compact() is called.
+        // \returns Number of updated strings
+        size_t update_weights(const tVPSU& string_weight) {
+            std::vector<tPUU> updates;
+            for (const auto& sw : string_weight) {
+                size_t idx = find_string(sw.first);
+                if ( idx != npos ) {
+                    updates.emplace_back(idx, sw.second);
+                }
+            }
+            update_weights(updates);
+            return updates.size();
+        }
+
+        // Set the weights of (index, weight)-pairs
+        void update_weights(const std::vector<tPUU>& idx_weight) {
+            m_overlay.apply(idx_weight);
+        }
+
+        // (index, weight)-pairs of the updates which are not compacted
+        std::vector<tPUU> updated_weights() const {
+            return m_overlay.snapshot()->entries();
+        }
+
+        // Merge the updated weights into the static weight structures.
+        // Must not run concurrently with queries or updates.
+        void compact() {
+            auto ov = m_overlay.snapshot();
+            if ( ov->empty() )
+                return;
+            sdsl::int_vector<> weight(m_weight.size(), 0);
+            for (size_t i=0; i < m_weight.size(); ++i) {
+                weight[i] = m_weight[i];
+            }
+            for (const auto& e : ov->entries()) {
+                weight[e.first] = e.second;
+            }
+            sdsl::util::bit_compress(weight);
+            m_rmq    = t_rmq(&weight);
+            m_weight = t_rac_weight(weight);
+            m_overlay.clear();
+        }
+
+        // Answer top-k queries for several prefixes at once
+        std::vector<tVPSU> top_k_batch(const std::vector<std::string>& prefixes, size_t k) const {
+            return topkcomp::top_k_batch(*this, prefixes, k);
         }
 
         // Serialize method
@@ -120,8 +195,22 @@ class index5 {
 
     private:
 
+        // Get (string, weight)-pairs of the k heaviest strings in range
+        tVPSU top_k_in_range(t_range range, size_t k) const {
+            auto ov = m_overlay.snapshot();
+            auto top_idx = ov->empty() ? heaviest_indexes_in_range(k, range, m_weight, m_rmq)
+                                       : ov->heaviest_indexes_in_range(k, range, m_weight, m_rmq);
+            TOPKCOMP_STAGE_TIMER(label);
+            tVPSU result_list;
+            for (auto idx : top_idx){
+                result_list.push_back(tPSU(label(idx), ov->weight(idx, m_weight)));
+            }
+            return result_list;
+        }
+
         // Return range [lb, rb) of matching strings
         std::array<size_t,2> prefix_range(const std::string& prefix) const {
+            TOPKCOMP_STAGE_TIMER(prefix_range);
             auto sa_range = lex_interval(m_csa, prefix.begin(), prefix.end());
             return {{m_start_rnk(sa_range[0]), m_start_rnk(sa_range[1]+1)}};
         }
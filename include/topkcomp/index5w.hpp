@@ -0,0 +1,225 @@
+#pragma once
+
+#include "index_common.hpp"
+#include <cctype>
+#include <sdsl/suffix_arrays.hpp>
+#include <sdsl/rmq_support.hpp>
+
+namespace topkcomp {
+
+// Like index5, but a prefix matches at the start of every word of a
+// string, e.g. `Amsterdam` suggests `Station Amsterdam Centraal`. The CSA
+// is built over the strings separated by character 1. The suffixes
+// which start a word are marked in SA order and mapped to their string;
+// top-k queries run on the weights of the strings in this order and
+// report each string at most once. The start of a string always counts
+// as a word start, so as in index5 each string matches its own prefixes,
+// also the empty string and strings of only separators.
+template<typename t_csa = sdsl::csa_wt<>,
+         typename t_rac_weight = sdsl::int_vector<>,
+         typename t_bv = sdsl::sd_vector<>,
+         typename t_rnk= typename t_bv::rank_1_type,
+         typename t_str_bv = sdsl::sd_vector<>,
+         typename t_str_sel = typename t_str_bv::select_1_type,
+         typename t_rmq = sdsl::rmq_succinct_sct<0>>
+class index5w {
+    // Weights in word start order; the weight of the string of each word start
+    struct word_weight_rac {
+        typedef uint64_t value_type;
+        const t_rac_weight*       m_weight;
+        const sdsl::int_vector<>* m_word_id;
+
+        value_type operator[](size_t i) const {
+            return (*m_weight)[(*m_word_id)[i]];
+        }
+    };
+
+    t_csa              m_csa;       // CSA of the separated strings
+    t_bv               m_word;      // marks suffixes in SA order which start a word
+    t_rnk              m_word_rnk;  // rank support structure for m_word
+    sdsl::int_vector<> m_word_id;   // string of the i-th word start in SA order
+    t_str_bv           m_str;       // marks starts of strings in the text
+    t_str_sel          m_str_sel;   // select support structure for m_str
+    t_rac_weight       m_weight;    // weights of strings
+    t_rmq              m_rmq;       // range maximum query on word start weights
+
+    public:
+        typedef size_t size_type;
+        typedef no_cursor cursor_type;
+        constexpr static bool case_sensitive = true;
+
+        // Constructor takes a sorted list of (string,weight)-pairs
+        index5w(const tVPSU& string_weight=tVPSU()) {
+            using namespace sdsl;
+            if ( !string_weight.empty() ) {
+                uint64_t N, n, max_weight;
+                std::tie(N, n, max_weight) = input_stats(string_weight);
+                {
+                    int_vector<> weight(N, 0, bits::hi(max_weight)+1);
+                    for (size_t i=0; i < N; ++i) {
+                        weight[i] = string_weight[i].second;
+                    }
+                    m_weight = t_rac_weight(weight);
+                }
+                // concatenate the strings, each followed by the separator
+                std::string concat;
+                concat.reserve(n+N);
+                int_vector<> str_id(n+N, 0, bits::hi(N)+1); // string of each text position
+                bit_vector word_start(n+N, 0);
+                {
+                    bit_vector str(n+N+1, 0);
+                    for (size_t i=0; i < N; ++i) {
+                        str[concat.size()] = 1;
+                        word_start[concat.size()] = 1; // for an empty string its separator
+                        const auto& s = string_weight[i].first;
+                        for (size_t j=0; j < s.size(); ++j) {
+                            if ( j > 0 and !is_separator(s[j]) and is_separator(s[j-1]) ) {
+                                word_start[concat.size()] = 1;
+                            }
+                            str_id[concat.size()] = i;
+                            concat.push_back(s[j]);
+                        }
+                        str_id[concat.size()] = i;
+                        concat.push_back(1);
+                    }
+                    str[concat.size()] = 1;
+                    m_str = t_str_bv(str);
+                }
+                // construct compressed suffix array
+                auto concat_file = tmp_file(std::string("./"),"_index5w");
+                store_to_file(concat.c_str(), concat_file);
+                cache_config cc(false, "./");
+                construct(m_csa, concat_file, cc, 1);
+                {
+                    // map the word starts in SA order to their strings
+                    bit_vector word(m_csa.size(), 0);
+                    int_vector<> word_weight(m_csa.size(), 0, bits::hi(max_weight)+1);
+                    m_word_id = int_vector<>(m_csa.size(), 0, bits::hi(N)+1);
+                    size_t words = 0;
+                    int_vector_buffer<> sa_buf(cache_file_name(conf::KEY_SA, cc));
+                    for (size_t i=0; i < sa_buf.size(); ++i) {
+                        size_t pos = sa_buf[i];
+                        if ( pos < concat.size() and word_start[pos] ) {
+                            word[i] = 1;
+                            m_word_id[words] = str_id[pos];
+                            word_weight[words] = m_weight[str_id[pos]];
+                            ++words;
+                        }
+                    }
+                    m_word_id.resize(words);
+                    word_weight.resize(words);
+                    util::bit_compress(m_word_id);
+                    m_word = t_bv(word);
+                    m_rmq = t_rmq(&word_weight);
+                }
+                util::delete_all_files(cc.file_map);
+                sdsl::remove(concat_file);
+                m_word_rnk = t_rnk(&m_word);
+                m_str_sel  = t_str_sel(&m_str);
+            }
+        }
+
+        // Number of (string, weight)-pairs in the index
+        size_type size() const {
+            return m_weight.size();
+        }
+
+        // k > 0
+        tVPSU top_k(const std::string& prefix, size_t k) const {
+            return top_k_in_range(prefix_range(prefix), k);
+        }
+
+        // k > 0; the CSA search can not be resumed, so the cursor is unused
+        tVPSU top_k(const std::string& prefix, size_t k, cursor_type&) const {
+            return top_k(prefix, k);
+        }
+
+        // Answer top-k queries for several prefixes at once
+        std::vector<tVPSU> top_k_batch(const std::vector<std::string>& prefixes, size_t k) const {
+            return topkcomp::top_k_batch(*this, prefixes, k);
+        }
+
+        // Serialize method
+        size_type
+        serialize(std::ostream& out, sdsl::structure_tree_node* v=nullptr,
+                  std::string name="") const {
+            using namespace sdsl;
+            auto child = structure_tree::add_child(v, name, util::class_name(*this));
+            size_type written_bytes = 0;
+            written_bytes += m_csa.serialize(out, child, "csa");
+            written_bytes += m_word.serialize(out, child, "word");
+            written_bytes += m_word_rnk.serialize(out, child, "word_rnk");
+            written_bytes += m_word_id.serialize(out, child, "word_id");
+            written_bytes += m_str.serialize(out, child, "str");
+            written_bytes += m_str_sel.serialize(out, child, "str_sel");
+            written_bytes += m_weight.serialize(out, child, "weight");
+            written_bytes += m_rmq.serialize(out, child, "rmq");
+            structure_tree::add_size(child, written_bytes);
+            return written_bytes;
+        }
+
+        // Load method
+        void load(std::istream& in) {
+            m_csa.load(in);
+            m_word.load(in);
+            m_word_rnk.load(in);
+            m_word_rnk.set_vector(&m_word);
+            m_word_id.load(in);
+            m_str.load(in);
+            m_str_sel.load(in);
+            m_str_sel.set_vector(&m_str);
+            m_weight.load(in);
+            m_rmq.load(in);
+        }
+
+    private:
+
+        // Characters which separate words; bytes of multi-byte UTF-8
+        // characters are part of words
+        static bool is_separator(char c) {
+            uint8_t u = c;
+            return u < 128 and (std::isspace(u) or std::ispunct(u));
+        }
+
+        // Get (string, weight)-pairs of the k heaviest strings with a word
+        // in range; each string is reported once. The reported ids are kept
+        // in a sorted vector, so a check costs O(log k). The enumeration
+        // passes over the other matching words of reported strings; if a
+        // string has up to m words in range, there are at most k*m checks.
+        tVPSU top_k_in_range(t_range range, size_t k) const {
+            word_weight_rac w{&m_weight, &m_word_id};
+            tVU ids; // sorted
+            auto top_words = heaviest_indexes_in_range(k, range, w, m_rmq, [&](size_t i){
+                size_t id = m_word_id[i];
+                auto it = std::lower_bound(ids.begin(), ids.end(), id);
+                if ( it != ids.end() and *it == id ) {
+                    return true; // another word of the string was reported
+                }
+                ids.insert(it, id);
+                return false;
+            });
+            TOPKCOMP_STAGE_TIMER(label);
+            tVPSU result_list;
+            for (auto i : top_words) {
+                size_t id = m_word_id[i];
+                result_list.push_back(tPSU(label(id), m_weight[id]));
+            }
+            return result_list;
+        }
+
+        // Return range [lb, rb) of matching word starts
+        t_range prefix_range(const std::string& prefix) const {
+            TOPKCOMP_STAGE_TIMER(prefix_range);
+            auto sa_range = lex_interval(m_csa, prefix.begin(), prefix.end());
+            return {{m_word_rnk(sa_range[0]), m_word_rnk(sa_range[1]+1)}};
+        }
+
+        // String id; extracted from the text without its separator
+        std::string label(size_t id) const {
+            size_t begin = m_str_sel(id+1);
+            size_t end   = m_str_sel(id+2)-1;
+            return begin < end ? sdsl::extract(m_csa, begin, end-1) : std::string();
+        }
+};
+
+} // end namespace topkcomp
@@ -0,0 +1,217 @@
+#pragma once
+
+#include "index_common.hpp"
+#include "bp_trie.hpp"
+#include "input_sort.hpp"
+#include <sdsl/bit_vectors.hpp>
+#include <sdsl/bp_support.hpp>
+#include <sdsl/rmq_support.hpp>
+
+namespace topkcomp {
+
+template<typename t_bv = sdsl::sd_vector<>,
+         typename t_sel= typename t_bv::select_1_type,
+         typename t_rac_weight = sdsl::int_vector<>,
+         typename t_bp_support = sdsl::bp_support_sada<>,
+         typename t_bp_rnk10 = sdsl::rank_support_v5<10,2>,
+         typename t_bp_sel10 = sdsl::select_support_mcl<10,2>,
+         typename t_rmq = sdsl::rmq_succinct_sct<0>,
+         typename t_rac_pos = sdsl::int_vector<>>
+class index6 {
+    typedef bp_trie<t_bv, t_sel, t_bp_support, t_bp_rnk10, t_bp_sel10> t_trie;
+    typedef typename t_trie::t_edge_label t_edge_label;
+
+    t_trie              m_trie;       // trie of the strings
+    t_rac_weight        m_weight;     // weights of strings 
+    t_rmq               m_rmq;        // range maximum query on m_weight
+    sdsl::int_vector<8> m_child_chars;// first characters of children grouped by parent
+    t_rac_pos           m_child_pos;  // positions of the children in m_bp
+    t_rac_pos           m_child_begin;// start of the group of node id i-1 in m_child_chars
+
+
+    public:
+        typedef size_t size_type;
+        constexpr static size_t npos = (size_t)-1;
+        typedef trie_cursor cursor_type;
+        constexpr static bool case_sensitive = true;
+
+        // Constructor takes a sorted list of (string,weight)-pairs
+        index6(const tVPSU& string_weight=tVPSU()) {
+            build(string_weight);
+        }
+
+        // Constructor takes a sorted input which is read sequentially, so
+        // the pairs do not have to be in memory at once
+        index6(const sorted_input& string_weight) {
+            build(string_weight);
+        }
+ 
+        // Number of (string, weight)-pairs in the index
+        size_type size() const {
+            return m_weight.size();
+        }
+
+        // k > 0
+        tVPSU top_k(const std::string& prefix, size_t k) const {
+            result_arena arena;
+            top_k_at_node(find_node(prefix), k, arena);
+            return arena.to_vector();
+        }
+
+        // k > 0; reuses the search state of the previous prefix
+        tVPSU top_k(const std::string& prefix, size_t k, cursor_type& cursor) const {
+            result_arena arena;
+            top_k_at_node(find_node(prefix, cursor), k, arena);
+            return arena.to_vector();
+        }
+
+        // k > 0; decodes the results into the reusable buffers of arena
+        void top_k(const std::string& prefix, size_t k, result_arena& arena) const {
+            top_k_at_node(find_node(prefix), k, arena);
+        }
+
+        // Answer top-k queries for several prefixes at once
+        std::vector<tVPSU> top_k_batch(const std::vector<std::string>& prefixes, size_t k) const {
+            return topkcomp::top_k_batch(*this, prefixes, k);
+        }
+
+        // Serialize method (calls serialize method of each member)
+        size_type
+        serialize(std::ostream& out, sdsl::structure_tree_node* v=nullptr,
+                  std::string name="") const {
+            using namespace sdsl;
+            auto child = structure_tree::add_child(v, name, util::class_name(*this));
+            size_type written_bytes = 0;
+            written_bytes += m_trie.serialize(out, child, "trie");
+            written_bytes += m_weight.serialize(out, child, "weight");
+            written_bytes += m_rmq.serialize(out, child, "rmq");
+            written_bytes += m_child_chars.serialize(out, child, "child_chars");
+            written_bytes += m_child_pos.serialize(out, child, "child_pos");
+            written_bytes += m_child_begin.serialize(out, child, "child_begin");
+            structure_tree::add_size(child, written_bytes);
+            return written_bytes;
+        }
+
+        // Load method (calls load method of each member)
+        void load(std::istream& in) {
+            m_trie.load(in);
+            m_weight.load(in);
+            m_rmq.load(in);
+            m_child_chars.load(in);
+            m_child_pos.load(in);
+            m_child_begin.load(in);
+        }
+
+    private:
+
+        // Build the index from an input of (string,weight)-pairs (see
+        // for_each_pair)
+        template<typename t_input>
+        void build(const t_input& string_weight) {
+            using namespace sdsl;
+            if ( !string_weight.empty() ) {
+                // build the succinct tree
+                m_trie = t_trie(string_weight, no_fold());
+                // initialize weight
+                {
+                    auto weight = weight_vector(string_weight);
+                    // initialize range maximum structure
+                    m_rmq = t_rmq(&weight);
+                    // intialize m_weight
+                    m_weight = t_rac_weight(weight);
+                }
+                // store first characters and positions of children
+                build_children();
+            }
+        }
+
+        // Decode the k heaviest strings in the sub tree of node v into
+        // arena; v = npos represents an empty sub tree
+        void top_k_at_node(size_t v, size_t k, result_arena& arena) const {
+            arena.clear();
+            if ( v == npos ) {
+                return;
+            }
+            decode(heaviest_indexes_in_range(k, node_range(v), m_weight, m_rmq), arena);
+        }
+
+        // Decode the strings at indexes top_idx into arena, in the order of top_idx
+        void decode(const tVU& top_idx, result_arena& arena) const {
+            m_trie.decode(top_idx, m_weight, arena);
+        }
+
+        // Store for each node the first characters of the edges to its
+        // children and the positions of the children in m_bp. The groups
+        // of children are stored in preorder of their parents and the
+        // group of node id i spans [m_child_begin[i-1], m_child_begin[i]).
+        // A string which is a prefix of another one ends in a leaf with an
+        // empty edge; its character is the sentinel 0, which sorts first.
+        void build_children() {
+            using namespace sdsl;
+            const auto& bp = m_trie.bp();
+            size_t nodes = m_trie.nodes();
+            m_child_chars = int_vector<8>(nodes-1);
+            int_vector<> child_pos(nodes-1, 0, bits::hi(bp.size())+1);
+            int_vector<> child_begin(nodes+1, 0, bits::hi(nodes)+1);
+            size_t g = 0;
+            for (size_t v=0, v_id=1; v < bp.size(); ++v) {
+                if ( bp[v] ) {
+                    child_begin[v_id-1] = g;
+                    for (auto cv : m_trie.children(v)) {
+                        auto e = m_trie.edge(m_trie.node_id(cv));
+                        m_child_chars[g] = e.size() > 0 ? e[0] : 0;
+                        child_pos[g++] = cv;
+                    }
+                    ++v_id;
+                }
+            }
+            child_begin[nodes] = g; // end of last group
+            m_child_pos   = t_rac_pos(child_pos);
+            m_child_begin = t_rac_pos(child_begin);
+        }
+
+        // Return the child of v whose edge starts with c and store its edge
+        // in w_edge, or npos. The sentinel of an empty edge matches no c.
+        size_t child(size_t v, uint8_t c, t_edge_label& w_edge) const {
+            if ( c == 0 ) {
+                return npos;
+            }
+            size_t v_id  = m_trie.node_id(v);
+            size_t begin = m_child_begin[v_id-1];
+            size_t end   = m_child_begin[v_id];
+            auto it = std::lower_bound(m_child_chars.begin()+begin, m_child_chars.begin()+end, c);
+            if ( it == m_child_chars.begin()+end or *it != c ) {
+                return npos;
+            }
+            size_t w = m_child_pos[it-m_child_chars.begin()];
+            w_edge = m_trie.edge(m_trie.node_id(w));
+            return w;
+        }
+
+        // Return the node whose sub tree holds the strings matching prefix
+        // or npos if there is no matching string
+        size_t find_node(const std::string& prefix) const {
+            return find_node(prefix, nullptr);
+        }
+
+        // Return the node whose sub tree holds the strings matching prefix
+        // or npos. The search continues from the state of the previous
+        // prefix stored in the cursor.
+        size_t find_node(const std::string& prefix, cursor_type& cursor) const {
+            return find_node(prefix, &cursor);
+        }
+
+        // find_node of the trie with one binary search per descent step
+        size_t find_node(const std::string& prefix, cursor_type* cursor) const {
+            return m_trie.find_node(prefix, cursor, [this](size_t v, uint8_t c, t_edge_label& w_edge) {
+                return child(v, c, w_edge);
+            });
+        }
+
+        // Map from sub tree rooted at v to strings in the original array
+        t_range node_range(size_t v) const {
+            return m_trie.node_range(v);
+        }
+};
+
+} // end namespace topkcomp
@@ -0,0 +1,175 @@
+#pragma once
+
+#include "index_common.hpp"
+#include "bp_trie.hpp"
+#include "front_coded_dict.hpp"
+#include <sdsl/bit_vectors.hpp>
+#include <sdsl/bp_support.hpp>
+#include <sdsl/rmq_support.hpp>
+
+namespace topkcomp {
+
+// Trie of index4 for the prefix search plus a front coded dictionary of
+// the strings for the extraction of the results. The i-th leaf of the
+// trie is the i-th string of the dictionary, so a result is decoded
+// without walking up the trie. The block size of t_dict selects the
+// trade-off between the space of the dictionary and the extraction time.
+template<typename t_dict = front_coded_dict<16>,
+         typename t_bv = sdsl::sd_vector<>,
+         typename t_sel= typename t_bv::select_1_type,
+         typename t_rac_weight = sdsl::int_vector<>,
+         typename t_bp_support = sdsl::bp_support_sada<>,
+         typename t_bp_rnk10 = sdsl::rank_support_v5<10,2>,
+         typename t_rmq = sdsl::rmq_succinct_sct<0>>
+class index7 {
+    // the dictionary replaces the leaf select structure of the trie
+    typedef bp_trie<t_bv, t_sel, t_bp_support, t_bp_rnk10, no_leaf_select> t_trie;
+
+    t_trie              m_trie;       // trie of the strings
+    t_rac_weight        m_weight;     // weights of strings
+    t_rmq               m_rmq;        // range maximum query on m_weight
+    t_dict              m_dict;       // strings in lexicographic order
+
+
+    public:
+        typedef size_t size_type;
+        constexpr static size_t npos = (size_t)-1;
+        typedef trie_cursor cursor_type;
+        constexpr static bool case_sensitive = true;
+
+        // Constructor takes a sorted list of (string,weight)-pairs
+        index7(const tVPSU& string_weight=tVPSU()) {
+            using namespace sdsl;
+            if ( !string_weight.empty() ) {
+                uint64_t N, n, max_weight;
+                std::tie(N, n, max_weight) = input_stats(string_weight);
+                // initialize weight
+                {
+                    int_vector<> weight(N, 0, bits::hi(max_weight)+1);
+                    for (size_t i=0; i < N; ++i) {
+                        weight[i] = string_weight[i].second;
+                    }
+                    // initialize range maximum structure
+                    m_rmq = t_rmq(&weight);
+                    // intialize m_weight
+                    m_weight = t_rac_weight(weight);
+                }
+                // build the succinct tree
+                m_trie = t_trie(string_weight);
+                // store the strings
+                m_dict = t_dict(string_weight);
+            }
+        }
+
+        // Number of (string, weight)-pairs in the index
+        size_type size() const {
+            return m_weight.size();
+        }
+
+        // k > 0
+        tVPSU top_k(const std::string& prefix, size_t k) const {
+            result_arena arena;
+            top_k_at_node(find_node(prefix), k, arena);
+            return arena.to_vector();
+        }
+
+        // k > 0; reuses the search state of the previous prefix
+        tVPSU top_k(const std::string& prefix, size_t k, cursor_type& cursor) const {
+            result_arena arena;
+            top_k_at_node(find_node(prefix, cursor), k, arena);
+            return arena.to_vector();
+        }
+
+        // k > 0; decodes the results into the reusable buffers of arena
+        void top_k(const std::string& prefix, size_t k, result_arena& arena) const {
+            top_k_at_node(find_node(prefix), k, arena);
+        }
+
+        // k > 0; calls out(string, weight) for the results in order of
+        // decreasing weight as soon as the RMQ enumeration selects them
+        template<class t_out>
+        void top_k_stream(const std::string& prefix, size_t k, cursor_type& cursor, t_out out) const {
+            size_t v = find_node(prefix, cursor);
+            if ( v == npos ) {
+                return;
+            }
+            typename t_dict::cursor c;
+            TOPKCOMP_STAGE_TIMER_PAUSED(label); // runs while the strings are extracted
+            for_each_heaviest_index(k, node_range(v), m_weight, m_rmq, [&](size_t idx){
+                TOPKCOMP_STAGE_RESUME(label);
+                const std::string& str = m_dict.extract(idx, c);
+                TOPKCOMP_STAGE_PAUSE(label);
+                out(str, (uint64_t)m_weight[idx]);
+            });
+        }
+
+        // Answer top-k queries for several prefixes at once
+        std::vector<tVPSU> top_k_batch(const std::vector<std::string>& prefixes, size_t k) const {
+            return topkcomp::top_k_batch(*this, prefixes, k);
+        }
+
+        // Serialize method (calls serialize method of each member)
+        size_type
+        serialize(std::ostream& out, sdsl::structure_tree_node* v=nullptr,
+                  std::string name="") const {
+            using namespace sdsl;
+            auto child = structure_tree::add_child(v, name, util::class_name(*this));
+            size_type written_bytes = 0;
+            written_bytes += m_trie.serialize(out, child, "trie");
+            written_bytes += m_weight.serialize(out, child, "weight");
+            written_bytes += m_rmq.serialize(out, child, "rmq");
+            written_bytes += m_dict.serialize(out, child, "dict");
+            structure_tree::add_size(child, written_bytes);
+            return written_bytes;
+        }
+
+        // Load method (calls load method of each member)
+        void load(std::istream& in) {
+            m_trie.load(in);
+            m_weight.load(in);
+            m_rmq.load(in);
+            m_dict.load(in);
+        }
+
+    private:
+
+        // Decode the k heaviest strings in the sub tree of node v into
+        // arena; v = npos represents an empty sub tree
+        void top_k_at_node(size_t v, size_t k, result_arena& arena) const {
+            arena.clear();
+            if ( v == npos ) {
+                return;
+            }
+            decode(heaviest_indexes_in_range(k, node_range(v), m_weight, m_rmq), arena);
+        }
+
+        // Extract the strings at indexes top_idx into arena, in the order
+        // of top_idx. The strings are extracted in lexicographic order, so
+        // results in the same block of the dictionary decode it only once.
+        void decode(const tVU& top_idx, result_arena& arena) const {
+            typename t_dict::cursor c;
+            decode_results(top_idx, m_weight, arena, [&](size_t idx, std::string& text) {
+                text.append(m_dict.extract(idx, c));
+            });
+        }
+
+        // Return the node whose sub tree holds the strings matching prefix
+        // or npos if there is no matching string
+        size_t find_node(const std::string& prefix) const {
+            return m_trie.find_node(prefix);
+        }
+
+        // Return the node whose sub tree holds the strings matching prefix
+        // or npos. The search continues from the state of the previous
+        // prefix stored in the cursor.
+        size_t find_node(const std::string& prefix, cursor_type& cursor) const {
+            return m_trie.find_node(prefix, &cursor);
+        }
+
+        // Map from sub tree rooted at v to strings in the original array
+        t_range node_range(size_t v) const {
+            return m_trie.node_range(v);
+        }
+};
+
+} // end namespace topkcomp
@@ -0,0 +1,360 @@
+#pragma once
+
+#include "index_common.hpp"
+#include "front_coded_dict.hpp"
+#include <sdsl/bit_vectors.hpp>
+#include <sdsl/rmq_support.hpp>
+
+namespace topkcomp {
+
+// Trie in level order unary degree sequence (LOUDS) encoding. Nodes are
+// numbered in breadth first order, so the children of a node are
+// consecutive and are located with two select queries on the LOUDS;
+// no find_close or enclose is needed. The first characters of the edges
+// of the children are stored contiguously and searched binary, the
+// remaining characters of the edge labels in m_labels. Leaves are not
+// numbered in lexicographic order; m_leaf_rank maps the i-th leaf in
+// breadth first order to the index of its string, and m_inner_range
+// stores the range of strings in the sub tree of each inner node. The
+// results are extracted from a front coded dictionary as in index7.
+template<typename t_dict = front_coded_dict<16>,
+         typename t_bv = sdsl::sd_vector<>,
+         typename t_sel= typename t_bv::select_1_type,
+         typename t_rac_weight = sdsl::int_vector<>,
+         typename t_louds_sel0 = sdsl::select_support_mcl<0,1>,
+         typename t_leaf_rnk = sdsl::rank_support_v5<1,1>,
+         typename t_rmq = sdsl::rmq_succinct_sct<0>>
+class index8 {
+    typedef sdsl::int_vector<8> t_label;
+    typedef edge_rac<t_label>   t_edge_label;
+
+    sdsl::bit_vector    m_louds;      // 10 followed by 1^d 0 for each node of degree d
+    t_louds_sel0        m_louds_sel0; // select for the ends of the degree sequences
+    sdsl::int_vector<8> m_first;      // first character of the edge leading to each node
+    t_label             m_labels;     // remaining characters of the edge labels
+    t_bv                m_start_bv;   // marks start of labels in m_labels
+    t_sel               m_start_sel;  // select structure for m_start_bv
+    sdsl::bit_vector    m_leaf;       // marks leaves
+    t_leaf_rnk          m_leaf_rnk;   // rank structure for m_leaf
+    sdsl::int_vector<>  m_leaf_rank;  // index of the string of each leaf
+    sdsl::int_vector<>  m_inner_range;// strings [m_inner_range[2i], m_inner_range[2i+1]) below the i-th inner node
+    t_rac_weight        m_weight;     // weights of strings
+    t_rmq               m_rmq;        // range maximum query on m_weight
+    t_dict              m_dict;       // strings in lexicographic order
+
+
+    public:
+        typedef size_t size_type;
+        constexpr static size_t npos = (size_t)-1;
+        typedef trie_cursor cursor_type;
+        constexpr static bool case_sensitive = true;
+
+        // Constructor takes a sorted list of (string,weight)-pairs
+        index8(const tVPSU& string_weight=tVPSU()) {
+            using namespace sdsl;
+            if ( !string_weight.empty() ) {
+                uint64_t N, n, max_weight;
+                std::tie(N, n, max_weight) = input_stats(string_weight);
+                // initialize weight
+                {
+                    int_vector<> weight(N, 0, bits::hi(max_weight)+1);
+                    for (size_t i=0; i < N; ++i) {
+                        weight[i] = string_weight[i].second;
+                    }
+                    // initialize range maximum structure
+                    m_rmq = t_rmq(&weight);
+                    // intialize m_weight
+                    m_weight = t_rac_weight(weight);
+                }
+                // build the succinct tree
+                build_tree(string_weight, N, n);
+                // initialize the support structures
+                m_louds_sel0 = t_louds_sel0(&m_louds);
+                m_start_sel  = t_sel(&m_start_bv);
+                m_leaf_rnk   = t_leaf_rnk(&m_leaf);
+                // store the strings
+                m_dict = t_dict(string_weight);
+            }
+        }
+
+        // Number of (string, weight)-pairs in the index
+        size_type size() const {
+            return m_weight.size();
+        }
+
+        // k > 0
+        tVPSU top_k(const std::string& prefix, size_t k) const {
+            result_arena arena;
+            top_k_at_node(find_node(prefix), k, arena);
+            return arena.to_vector();
+        }
+
+        // k > 0; reuses the search state of the previous prefix
+        tVPSU top_k(const std::string& prefix, size_t k, cursor_type& cursor) const {
+            result_arena arena;
+            top_k_at_node(find_node(prefix, cursor), k, arena);
+            return arena.to_vector();
+        }
+
+        // k > 0; decodes the results into the reusable buffers of arena
+        void top_k(const std::string& prefix, size_t k, result_arena& arena) const {
+            top_k_at_node(find_node(prefix), k, arena);
+        }
+
+        // k > 0; calls out(string, weight) for the results in order of
+        // decreasing weight as soon as the RMQ enumeration selects them
+        template<class t_out>
+        void top_k_stream(const std::string& prefix, size_t k, cursor_type& cursor, t_out out) const {
+            size_t v = find_node(prefix, cursor);
+            if ( v == npos ) {
+                return;
+            }
+            typename t_dict::cursor c;
+            TOPKCOMP_STAGE_TIMER_PAUSED(label); // runs while the strings are extracted
+            for_each_heaviest_index(k, node_range(v), m_weight, m_rmq, [&](size_t idx){
+                TOPKCOMP_STAGE_RESUME(label);
+                const std::string& str = m_dict.extract(idx, c);
+                TOPKCOMP_STAGE_PAUSE(label);
+                out(str, (uint64_t)m_weight[idx]);
+            });
+        }
+
+        // Answer top-k queries for several prefixes at once
+        std::vector<tVPSU> top_k_batch(const std::vector<std::string>& prefixes, size_t k) const {
+            return topkcomp::top_k_batch(*this, prefixes, k);
+        }
+
+        // Serialize method (calls serialize method of each member)
+        size_type
+        serialize(std::ostream& out, sdsl::structure_tree_node* v=nullptr,
+                  std::string name="") const {
+            using namespace sdsl;
+            auto child = structure_tree::add_child(v, name, util::class_name(*this));
+            size_type written_bytes = 0;
+            written_bytes += m_louds.serialize(out, child, "louds");
+            written_bytes += m_louds_sel0.serialize(out, child, "louds_sel0");
+            written_bytes += m_first.serialize(out, child, "first");
+            written_bytes += m_labels.serialize(out, child, "labels");
+            written_bytes += m_start_bv.serialize(out, child, "start_bv");
+            written_bytes += m_start_sel.serialize(out, child, "start_sel");
+            written_bytes += m_leaf.serialize(out, child, "leaf");
+            written_bytes += m_leaf_rnk.serialize(out, child, "leaf_rnk");
+            written_bytes += m_leaf_rank.serialize(out, child, "leaf_rank");
+            written_bytes += m_inner_range.serialize(out, child, "inner_range");
+            written_bytes += m_weight.serialize(out, child, "weight");
+            written_bytes += m_rmq.serialize(out, child, "rmq");
+            written_bytes += m_dict.serialize(out, child, "dict");
+            structure_tree::add_size(child, written_bytes);
+            return written_bytes;
+        }
+
+        // Load method (calls load method of each member)
+        void load(std::istream& in) {
+            m_louds.load(in);
+            m_louds_sel0.load(in);
+            m_louds_sel0.set_vector(&m_louds);
+            m_first.load(in);
+            m_labels.load(in);
+            m_start_bv.load(in);
+            m_start_sel.load(in);
+            m_start_sel.set_vector(&m_start_bv);
+            m_leaf.load(in);
+            m_leaf_rnk.load(in);
+            m_leaf_rnk.set_vector(&m_leaf);
+            m_leaf_rank.load(in);
+            m_inner_range.load(in);
+            m_weight.load(in);
+            m_rmq.load(in);
+            m_dict.load(in);
+        }
+
+    private:
+
+        // Decode the k heaviest strings in the sub tree of node v into
+        // arena; v = npos represents an empty sub tree
+        void top_k_at_node(size_t v, size_t k, result_arena& arena) const {
+            arena.clear();
+            if ( v == npos ) {
+                return;
+            }
+            decode(heaviest_indexes_in_range(k, node_range(v), m_weight, m_rmq), arena);
+        }
+
+        // Extract the strings at indexes top_idx into arena, in the order
+        // of top_idx. The strings are extracted in lexicographic order, so
+        // results in the same block of the dictionary decode it only once.
+        void decode(const tVU& top_idx, result_arena& arena) const {
+            typename t_dict::cursor c;
+            decode_results(top_idx, m_weight, arena, [&](size_t idx, std::string& text) {
+                text.append(m_dict.extract(idx, c));
+            });
+        }
+
+        // Build the LOUDS of the trie of the strings by a breadth first
+        // traversal. Each node is a range [lb, rb) of strings of which
+        // depth characters are matched above its edge.
+        void build_tree(const tVPSU& string_weight, size_t N, size_t n) {
+            using namespace sdsl;
+            struct node { size_t lb, rb, depth; };
+            std::vector<node> queue(1, node{0, N, 0});
+            queue.reserve(2*N);
+            bit_vector louds(2+2*2*N, 0);      // initialize to worst case size
+            bit_vector start_bv(2*N+n+2, 0);   // initialize to worst case size
+            bit_vector leaf(2*N, 0);           // initialize to worst case size
+            int_vector<8> first(2*N, 0);       // initialize to worst case size
+            m_labels    = int_vector<8>(n);    // initialize to worst case size
+            m_leaf_rank = int_vector<>(N, 0, bits::hi(N)+1);
+            m_inner_range = int_vector<>(2*N, 0, bits::hi(N)+1);
+            size_t l = 0, s = 0, lab = 0, leaves = 0;
+            louds[l++] = 1; l++;               // super root
+            start_bv[s++] = 1;                 // mark start of first label
+            for (size_t x=0; x < queue.size(); ++x) {
+                size_t lb = queue[x].lb, rb = queue[x].rb, d = queue[x].depth;
+                const uint8_t* lb_entry = (const uint8_t*)(string_weight[lb].first.c_str());
+                const uint8_t* rb_entry = (const uint8_t*)(string_weight[rb-1].first.c_str());
+                if ( x > 0 and lb_entry[d] != 0 ) { // the root has no first character
+                    first[x] = lb_entry[d++];
+                }
+                // extend common prefix
+                while ( lb_entry[d] !=0 and lb_entry[d] == rb_entry[d] ) {
+                    m_labels[lab++] = lb_entry[d]; // store common char
+                    ++s; ++d;
+                }
+                start_bv[s++] = 1; // mark end of edge label
+                if ( lb+1 < rb ) { // append the children to the queue
+                    m_inner_range[2*(x-leaves)]   = lb;
+                    m_inner_range[2*(x-leaves)+1] = rb;
+                    while ( lb < rb ) {
+                        uint8_t c = string_weight[lb].first.c_str()[d];
+                        size_t mid = lb+1;
+                        while ( mid < rb and ((uint8_t)string_weight[mid].first.c_str()[d]) == c ) {
+                            ++mid;
+                        }
+                        queue.push_back(node{lb, mid, d});
+                        louds[l++] = 1;
+                        lb = mid;
+                    }
+                } else {
+                    leaf[x] = 1;
+                    m_leaf_rank[leaves++] = lb;
+                }
+                l++; // end of degree sequence
+            }
+            louds.resize(l);               // resize to actual size
+            start_bv.resize(s);            // resize to actual size
+            leaf.resize(queue.size());     // resize to actual size
+            m_inner_range.resize(2*(queue.size()-leaves)); // resize to actual size
+            first.resize(queue.size());    // resize to actual size
+            m_labels.resize(lab);          // resize to actual size
+
+            m_louds    = louds;
+            m_first    = first;
+            m_leaf     = leaf;
+            m_start_bv = t_bv(start_bv);   // copy to member bitvector
+        }
+
+        // Return the node whose sub tree holds the strings matching prefix
+        // or npos if there is no matching string
+        size_t find_node(const std::string& prefix) const {
+            return find_node(prefix, 0, 0, 0, nullptr);
+        }
+
+        // Return the node whose sub tree holds the strings matching prefix
+        // or npos. The search continues from the state of the previous
+        // prefix stored in the cursor.
+        size_t find_node(const std::string& prefix, cursor_type& cursor) const {
+            size_t v, m, o;
+            if ( !cursor.resume(prefix, v, m, o) ) {
+                return npos;
+            }
+            return find_node(prefix, v, m, o, &cursor);
+        }
+
+        // Return the node whose sub tree holds the strings matching prefix
+        // or npos. The search starts at node v
+        // with prefix[0..m-1] matched, of which the last o characters are
+        // on the edge leading to v. If cursor is not null, entered nodes are
+        // appended to its path and the end of the search is recorded. The
+        // edge of a node other than the root is its first character
+        // followed by its label.
+        size_t find_node(const std::string& prefix, size_t v, size_t m, size_t o,
+                         cursor_type* cursor) const {
+            TOPKCOMP_STAGE_TIMER(prefix_range);
+            auto v_edge = edge(v);
+            size_t f = is_root(v) ? 0 : 1; // characters of the edge before v_edge
+            while ( m < prefix.size() ) {
+                if ( o < f + v_edge.size() ) { // continue matching the edge
+                    uint8_t c = o < f ? m_first[v] : v_edge[o-f];
+                    if ( ((uint8_t)prefix[m]) != c ) { // mismatch
+                        if ( cursor != nullptr ) cursor->finish(v, o, false);
+                        return npos;
+                    }
+                    ++m; ++o;
+                } else { // edge exhausted -> search child
+                    size_t w = child(v, prefix[m]);
+                    if ( w == npos ) { // no matching child found
+                        if ( cursor != nullptr ) cursor->finish(v, o, false);
+                        return npos;
+                    }
+                    v = w;
+                    v_edge = edge(v);
+                    f = 1;
+                    if ( cursor != nullptr ) {
+                        cursor->path.emplace_back(v, m);
+                    }
+                    ++m; o = 1;
+                }
+            }
+            if ( cursor != nullptr ) cursor->finish(v, o, true);
+            return v;
+        }
+
+        // Return the child of v whose edge starts with c or npos. The
+        // children of v are the nodes [first_child(v), first_child(v+1)).
+        size_t child(size_t v, uint8_t c) const {
+            size_t begin = first_child(v);
+            size_t end   = first_child(v+1);
+            auto it = std::lower_bound(m_first.begin()+begin, m_first.begin()+end, c);
+            if ( it == m_first.begin()+end or *it != c ) {
+                return npos;
+            }
+            return it-m_first.begin();
+        }
+
+        // First child of v; the position of the first child of v+1 if v
+        // is a leaf. The degree sequence of v follows the (v+1)-th 0.
+        size_t first_child(size_t v) const {
+            return m_louds_sel0(v+1) - v;
+        }
+
+        // Map from sub tree rooted at v to strings in the original array
+        t_range node_range(size_t v) const {
+            size_t leaves = m_leaf_rnk(v); // leaves before v
+            if ( is_leaf(v) ) {
+                size_t idx = m_leaf_rank[leaves];
+                return {{idx, idx+1}};
+            }
+            size_t i = v - leaves;         // v is the i-th inner node
+            return {{m_inner_range[2*i], m_inner_range[2*i+1]}};
+        }
+
+        // Get the label of the edge leading to v without its first character
+        t_edge_label edge(size_t v) const{
+            size_t v_id  = v+1;
+            size_t begin = m_start_sel(v_id) + 1 - v_id;
+            size_t end   = m_start_sel(v_id+1) + 1 - (v_id+1);
+            return t_edge_label(&m_labels, begin, end);
+        }
+
+        // Check if v is a leaf
+        bool is_leaf(size_t v) const {
+            return m_leaf[v];
+        }
+
+        // Check if v is the root node
+        bool is_root(size_t v) const {
+            return v == 0;
+        }
+};
+
+} // end namespace topkcomp
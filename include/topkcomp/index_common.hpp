@@ -2,9 +2,15 @@
 
 #include <string>
 #include <utility>
+#include <tuple>
 #include <queue>
 #include <array>
+#include <numeric>
+#include <algorithm>
+#include <type_traits>
 #include <sdsl/int_vector.hpp>
+#include <sdsl/construct.hpp>
+#include "metrics.hpp"
 
 namespace topkcomp{
     // helpful typedefs
@@ -34,9 +40,33 @@ namespace topkcomp{
         return tTUUU(string_weight.size(), n, max_weight);
     }
 
+    // Call f(i, string, weight) for the i-th pair of a list of (string,
+    // weight)-pairs. Index constructors which read their input only with
+    // for_each_pair and input_stats also accept a sorted_input (see
+    // input_sort.hpp), which streams the pairs from disk.
+    template<typename t_f>
+    void for_each_pair(const tVPSU& string_weight, t_f f) {
+        for (size_t i=0; i < string_weight.size(); ++i) {
+            f(i, string_weight[i].first, string_weight[i].second);
+        }
+    }
+
+    // Weights of a non-empty input in a bit-compressed vector
+    template<typename t_input>
+    sdsl::int_vector<> weight_vector(const t_input& string_weight) {
+        uint64_t N, n, max_weight;
+        std::tie(N, n, max_weight) = input_stats(string_weight);
+        sdsl::int_vector<> weight(N, 0, sdsl::bits::hi(max_weight)+1);
+        for_each_pair(string_weight, [&](size_t i, const std::string&, uint64_t w) {
+            weight[i] = w;
+        });
+        return weight;
+    }
+
     // Get k heaviest indexes in range r
     template<typename t_rac_weight>
     tVU heaviest_indexes_in_range(size_t k, t_range r, const t_rac_weight& w){
+        TOPKCOMP_STAGE_TIMER(heaviest_indexes_in_range);
          // min-priority queue holds (weight, index)-pairs
         std::priority_queue<tPUU, std::vector<tPUU>, std::greater<tPUU>> pq;
         for (size_t i=r[0]; i<r[1]; ++i){
@@ -56,37 +86,454 @@ namespace topkcomp{
         return res; 
     }
 
-    // helper struct for top-k calculation with rmq
+    // Length of the longest common prefix of a and b
+    inline size_t lcp(const std::string& a, const std::string& b) {
+        size_t l = 0;
+        while ( l < a.size() and l < b.size() and a[l] == b[l] ) {
+            ++l;
+        }
+        return l;
+    }
+
+    // Append x to data in a variable byte code: 7 bits per byte, the
+    // highest bit marks that more bytes follow
+    inline void put_varint(uint64_t x, std::string& data) {
+        while ( x >= 128 ) {
+            data.push_back((char)(0x80 | (x & 0x7F)));
+            x >>= 7;
+        }
+        data.push_back((char)x);
+    }
+
+    // Read the variable byte code at data[p..] and move p behind it
+    template<typename t_data>
+    uint64_t get_varint(const t_data& data, size_t& p) {
+        uint64_t x = 0;
+        for (size_t shift = 0; ; shift += 7) {
+            uint64_t b = data[p++];
+            x |= (b & 0x7F) << shift;
+            if ( b < 128 ) {
+                return x;
+            }
+        }
+    }
+
+    // Search state for indexes which narrow the range character by
+    // character (index1, index2): ranges[i] is the range of strings
+    // prefixed by the first i characters of prefix.
+    struct range_cursor {
+        std::string          prefix;
+        std::vector<t_range> ranges;
+
+        // Prepare search for new_prefix; \returns number of characters
+        // of new_prefix which are already matched by ranges.back()
+        size_t resume(const std::string& new_prefix) {
+            size_t l = lcp(prefix, new_prefix);
+            if ( ranges.size() > l+1 ) {
+                ranges.resize(l+1);
+            }
+            prefix = new_prefix;
+            return ranges.empty() ? 0 : ranges.size()-1;
+        }
+    };
+
+    // Search state for trie based indexes. It can be kept for a whole
+    // session of keystrokes: if a prefix extends the previous one, the
+    // search continues at the position (node plus offset within the edge
+    // label) where the previous search ended. Otherwise it restarts at the
+    // deepest node of path which is shared with the previous prefix.
+    // path stores for each node entered below the root the pair (v, m),
+    // where v is the position of the node in the balanced parentheses
+    // sequence and m the number of prefix characters matched above the
+    // edge leading to v.
+    struct trie_cursor {
+        std::string       prefix;
+        std::vector<tPUU> path;
+        size_t            node   = 0;     // node where the last search ended
+        size_t            offset = 0;     // matched characters on the edge leading to node
+        bool              found  = false; // last prefix was matched completely
+        bool              valid  = false; // node, offset and found describe prefix
+
+        // Prepare search for new_prefix
+        // \returns false if new_prefix can not match, since it extends a
+        //          previous prefix which did not match. Otherwise the search
+        //          state (v, m, o) to continue from is returned in the arguments
+        bool resume(const std::string& new_prefix, size_t& v, size_t& m, size_t& o) {
+            size_t l = lcp(prefix, new_prefix);
+            bool extends = valid and l == prefix.size();
+            prefix = new_prefix;
+            if ( extends ) {
+                v = node; m = l; o = offset;
+                return found;
+            }
+            valid = false;
+            // keep only nodes whose edge was chosen by a shared character
+            while ( !path.empty() and path.back().second >= l ) {
+                path.pop_back();
+            }
+            v = 0; m = 0; o = 0;
+            if ( !path.empty() ) {
+                std::tie(v, m) = path.back();
+            }
+            return true;
+        }
+
+        // Record where the search for prefix ended
+        void finish(size_t v, size_t o, bool f) {
+            node = v; offset = o; found = f; valid = true;
+        }
+    };
+
+    // Search state for indexes which can not reuse a previous search
+    struct no_cursor {};
+
+    // Results of a top-k query decoded into one buffer. Result i is the
+    // string text[pos[i].first..pos[i].first+pos[i].second) with weight
+    // weight[i]. An arena which is reused for many queries keeps its
+    // capacity, so decoding into it does no heap allocations after
+    // warm-up. The top_k overloads which return a tVPSU use a fresh arena
+    // and copy the strings out; only top_k(prefix, k, arena) with a
+    // long-lived arena, e.g. one per worker thread, avoids the allocations.
+    struct result_arena {
+        std::string         text;
+        std::vector<tPUU>   pos;
+        tVU                 weight;
+        // scratch space of the label decoder
+        tVU                 order;
+        tVU                 path;
+        tVU                 path_len;
+        tVU                 up;
+        std::string         cur;
+
+        void clear() {
+            text.clear(); pos.clear(); weight.clear();
+        }
+
+        size_t size() const {
+            return pos.size();
+        }
+
+        // Pointer to the i-th string; its length is pos[i].second
+        const char* data(size_t i) const {
+            return text.data() + pos[i].first;
+        }
+
+        std::string str(size_t i) const {
+            return text.substr(pos[i].first, pos[i].second);
+        }
+
+        // Copy results to a list of (string, weight)-pairs
+        tVPSU to_vector() const {
+            tVPSU result_list;
+            result_list.reserve(size());
+            for (size_t i=0; i < size(); ++i) {
+                result_list.emplace_back(str(i), weight[i]);
+            }
+            return result_list;
+        }
+    };
+
+    // Decode the strings at indexes top_idx with their weights into arena,
+    // in the order of top_idx. The strings are decoded in increasing order
+    // of their indexes, so a decoder can continue from the previous string:
+    // append(idx, text) appends string idx to text.
+    template<typename t_rac_weight, typename t_append>
+    void decode_results(const tVU& top_idx, const t_rac_weight& weight,
+                        result_arena& arena, t_append append) {
+        TOPKCOMP_STAGE_TIMER(label);
+        arena.clear();
+        arena.pos.resize(top_idx.size());
+        arena.weight.resize(top_idx.size());
+        auto& order = arena.order;
+        order.resize(top_idx.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b){
+            return top_idx[a] < top_idx[b];
+        });
+        for (auto i : order) {
+            size_t begin = arena.text.size();
+            append(top_idx[i], arena.text);
+            arena.pos[i] = tPUU(begin, arena.text.size()-begin);
+            arena.weight[i] = weight[top_idx[i]];
+        }
+    }
+
+    // Positions of prefixes in sorted order of the prefixes
+    inline std::vector<size_t> sorted_order(const std::vector<std::string>& prefixes) {
+        std::vector<size_t> order(prefixes.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b){
+            return prefixes[a] < prefixes[b];
+        });
+        return order;
+    }
+
+    // Answer top-k queries for a list of prefixes. Prefixes are processed
+    // in sorted order with one cursor, so that each search can reuse the
+    // state of the previous search for common leading characters. The
+    // result lists are returned in the order of the input.
+    template<typename t_index>
+    std::vector<tVPSU> top_k_batch(const t_index& index,
+                                   const std::vector<std::string>& prefixes,
+                                   size_t k) {
+        std::vector<size_t> order = sorted_order(prefixes);
+        std::vector<tVPSU> res(prefixes.size());
+        typename t_index::cursor_type cursor;
+        for (size_t j=0; j < order.size(); ++j) {
+            size_t i = order[j];
+            if ( j > 0 and prefixes[i] == prefixes[order[j-1]] ) {
+                res[i] = res[order[j-1]];
+            } else {
+                res[i] = index.top_k(prefixes[i], k, cursor);
+            }
+        }
+        return res;
+    }
+
+    // helper struct for top-k calculation with rmq; idx is the position
+    // of the maximum in [lb, rb), which lies in the r-th range, and s its score
+    template<typename t_score>
     struct weight_interval{
-        uint64_t w;
-        size_t idx, lb, rb;
-        weight_interval(uint64_t f_w, size_t f_idx, size_t f_lb, size_t f_rb) : 
-            w(f_w), idx(f_idx), lb(f_lb), rb(f_rb) {}
+        t_score s;
+        size_t idx, lb, rb, r;
+        weight_interval(t_score f_s, size_t f_idx, size_t f_lb, size_t f_rb, size_t f_r) :
+            s(f_s), idx(f_idx), lb(f_lb), rb(f_rb), r(f_r) {}
 
         bool operator<(const weight_interval& wi) const {
-            return std::tie(w, idx, lb, rb) < std::tie(wi.w, wi.idx, wi.lb, wi.rb);
+            return std::tie(s, idx, lb, rb) < std::tie(wi.s, wi.idx, wi.lb, wi.rb);
         }
     };
 
-    // Get k heaviest indexes in range r using a rmq structure
-    template<typename t_rac_weight, typename t_rmq>
-    tVU heaviest_indexes_in_range(size_t k, t_range r, const t_rac_weight& w, const t_rmq& rmq){
-        std::priority_queue<weight_interval> pq;
-        auto push_interval = [&](size_t f_lb, size_t f_rb) {
+    // Get the k indexes of highest score in the union of disjoint ranges
+    // using a rmq structure. The score of index idx in the i-th range is
+    // score(w[idx], i) and has to be monotone in the weight. The heap is
+    // seeded with the maximum of each range, so no range is asked for
+    // more candidates than it contributes to the result. Indexes idx
+    // with skip(idx) = true are not reported.
+    template<typename t_rac_weight, typename t_rmq, typename t_score, typename t_skip>
+    tVU heaviest_indexes_in_ranges(size_t k, const std::vector<t_range>& ranges,
+                                   const t_rac_weight& w, const t_rmq& rmq,
+                                   t_score score, t_skip skip){
+        TOPKCOMP_STAGE_TIMER(heaviest_indexes_in_range);
+        typedef weight_interval<decltype(score(uint64_t(0), size_t(0)))> t_interval;
+        std::priority_queue<t_interval> pq;
+        auto push_interval = [&](size_t f_lb, size_t f_rb, size_t f_r) {
             if ( f_rb > f_lb ) {
                 size_t max_idx = rmq(f_lb, f_rb-1);
-                pq.push(weight_interval(w[max_idx], max_idx, f_lb, f_rb));
+                pq.push(t_interval(score((uint64_t)w[max_idx], f_r), max_idx, f_lb, f_rb, f_r));
             }
         };
         tVU res;
-        push_interval(r[0], r[1]);
+        for (size_t i=0; i < ranges.size(); ++i) {
+            push_interval(ranges[i][0], ranges[i][1], i);
+        }
         while ( res.size() < k and !pq.empty() ) {
             auto iv = pq.top(); pq.pop();
-            res.push_back(iv.idx);
+            if ( !skip(iv.idx) ) {
+                res.push_back(iv.idx);
+            }
+            push_interval(iv.lb, iv.idx, iv.r);
+            push_interval(iv.idx+1, iv.rb, iv.r);
+        }
+        return res;
+    }
+
+    // Get k heaviest indexes in the union of disjoint ranges using a rmq structure
+    template<typename t_rac_weight, typename t_rmq>
+    tVU heaviest_indexes_in_ranges(size_t k, const std::vector<t_range>& ranges,
+                                   const t_rac_weight& w, const t_rmq& rmq){
+        return heaviest_indexes_in_ranges(k, ranges, w, rmq,
+                                          [](uint64_t weight, size_t){ return weight; },
+                                          [](size_t){ return false; });
+    }
+
+    // Get k heaviest indexes in range r using a rmq structure. Indexes
+    // idx with skip(idx) = true are not reported.
+    template<typename t_rac_weight, typename t_rmq, typename t_skip>
+    tVU heaviest_indexes_in_range(size_t k, t_range r, const t_rac_weight& w, const t_rmq& rmq, t_skip skip){
+        return heaviest_indexes_in_ranges(k, std::vector<t_range>{r}, w, rmq,
+                                          [](uint64_t weight, size_t){ return weight; }, skip);
+    }
+
+    // Max-heap of intervals with a capacity fixed at construction. Heaps
+    // of up to 32 intervals live on the stack, larger ones are allocated
+    // once. Intervals are ordered by the weight of their maximum; equal
+    // weights by its index, which is unique among disjoint intervals.
+    class bounded_interval_heap {
+        public:
+            struct interval {
+                uint64_t w;
+                size_t   idx, lb, rb;
+            };
+
+        private:
+            std::array<interval, 32> m_local;
+            std::vector<interval>    m_spill;
+            interval*                m_data;
+            size_t                   m_size = 0;
+
+            static bool less(const interval& a, const interval& b) {
+                return a.w < b.w or (a.w == b.w and a.idx < b.idx);
+            }
+
+        public:
+            explicit bounded_interval_heap(size_t capacity) {
+                if ( capacity > m_local.size() ) {
+                    m_spill.resize(capacity);
+                    m_data = m_spill.data();
+                } else {
+                    m_data = m_local.data();
+                }
+            }
+            bounded_interval_heap(const bounded_interval_heap&) = delete;
+            bounded_interval_heap& operator=(const bounded_interval_heap&) = delete;
+
+            bool empty() const { return m_size == 0; }
+
+            const interval& top() const { return m_data[0]; }
+
+            void push(const interval& iv) {
+                size_t i = m_size++;
+                while ( i > 0 and less(m_data[(i-1)/2], iv) ) {
+                    m_data[i] = m_data[(i-1)/2];
+                    i = (i-1)/2;
+                }
+                m_data[i] = iv;
+            }
+
+            void pop() {
+                const interval last = m_data[--m_size];
+                size_t i = 0;
+                while ( 2*i+1 < m_size ) {
+                    size_t c = 2*i+1;
+                    if ( c+1 < m_size and less(m_data[c], m_data[c+1]) ) {
+                        ++c;
+                    }
+                    if ( !less(last, m_data[c]) ) {
+                        break;
+                    }
+                    m_data[i] = m_data[c];
+                    i = c;
+                }
+                m_data[i] = last;
+            }
+    };
+
+    // Call out(idx) for the k heaviest indexes in range r in order of
+    // decreasing weight using a rmq structure. After j < k reported
+    // indexes the heap holds at most j+1 disjoint, non-empty intervals
+    // of r, so a heap of capacity min(k, |r|) suffices and each weight
+    // is read once. The heap allocates only if this capacity exceeds 32.
+    template<typename t_rac_weight, typename t_rmq, typename t_out>
+    void for_each_heaviest_index(size_t k, t_range r, const t_rac_weight& w, const t_rmq& rmq, t_out out){
+        TOPKCOMP_STAGE_TIMER(heaviest_indexes_in_range);
+        if ( k == 0 or r[1] <= r[0] ) {
+            return;
+        }
+        bounded_interval_heap heap(std::min(k, r[1]-r[0]));
+        auto push_interval = [&](size_t f_lb, size_t f_rb) {
+            if ( f_rb > f_lb ) {
+                size_t max_idx = rmq(f_lb, f_rb-1);
+                heap.push({(uint64_t)w[max_idx], max_idx, f_lb, f_rb});
+            }
+        };
+        push_interval(r[0], r[1]);
+        for (size_t reported = 0; !heap.empty(); ) {
+            auto iv = heap.top(); heap.pop();
+            TOPKCOMP_STAGE_PAUSE(heaviest_indexes_in_range); // out is not part of the stage
+            out(iv.idx);
+            TOPKCOMP_STAGE_RESUME(heaviest_indexes_in_range);
+            if ( ++reported == k ) {
+                break;
+            }
             push_interval(iv.lb, iv.idx);
             push_interval(iv.idx+1, iv.rb);
         }
-        return res; 
+    }
+
+    // Get k heaviest indexes in range r using a rmq structure
+    template<typename t_rac_weight, typename t_rmq>
+    tVU heaviest_indexes_in_range(size_t k, t_range r, const t_rac_weight& w, const t_rmq& rmq){
+        tVU res;
+        res.reserve(r[1] > r[0] ? std::min(k, r[1]-r[0]) : 0);
+        for_each_heaviest_index(k, r, w, rmq, [&](size_t idx){ res.push_back(idx); });
+        return res;
+    }
+
+    // Get the k heaviest indexes of each range in ranges using a rmq
+    // structure. Ranges are nested or disjoint and a range follows the
+    // ranges which contain it, like the node ranges of sorted prefixes.
+    // The enumeration of a range ends with intervals which cover its
+    // unreported indexes. A nested range starts from the results of the
+    // innermost enclosing range which lie in it and from these intervals
+    // clipped to it; only the at most two intervals which cross its
+    // borders need a new rmq. So a prefix of the batch which extends
+    // another one continues its enumeration instead of starting over.
+    template<typename t_rac_weight, typename t_rmq>
+    std::vector<tVU> heaviest_indexes_in_nested_ranges(size_t k, const std::vector<t_range>& ranges,
+                                                       const t_rac_weight& w, const t_rmq& rmq){
+        TOPKCOMP_STAGE_TIMER(heaviest_indexes_in_range);
+        typedef bounded_interval_heap::interval t_interval;
+        struct enumeration {
+            t_range                 r;
+            size_t                  i;    // position of r in ranges
+            std::vector<t_interval> rest; // intervals of unreported indexes
+        };
+        auto less = [](const t_interval& a, const t_interval& b) {
+            return a.w < b.w or (a.w == b.w and a.idx < b.idx);
+        };
+        std::vector<t_interval> heap;
+        auto push = [&](const t_interval& iv) {
+            heap.push_back(iv);
+            std::push_heap(heap.begin(), heap.end(), less);
+        };
+        auto push_interval = [&](size_t f_lb, size_t f_rb) {
+            if ( f_rb > f_lb ) {
+                size_t max_idx = rmq(f_lb, f_rb-1);
+                push({(uint64_t)w[max_idx], max_idx, f_lb, f_rb});
+            }
+        };
+        std::vector<tVU> res(ranges.size());
+        std::vector<enumeration> enclosing;
+        for (size_t i=0; i < ranges.size(); ++i) {
+            const t_range r = ranges[i];
+            if ( r[0] >= r[1] ) {
+                continue;
+            }
+            while ( !enclosing.empty() and (r[0] < enclosing.back().r[0] or enclosing.back().r[1] < r[1]) ) {
+                enclosing.pop_back();
+            }
+            heap.clear();
+            if ( enclosing.empty() ) {
+                push_interval(r[0], r[1]);
+            } else {
+                const enumeration& e = enclosing.back();
+                for (size_t idx : res[e.i]) {
+                    if ( r[0] <= idx and idx < r[1] ) {
+                        res[i].push_back(idx);
+                    }
+                }
+                for (t_interval iv : e.rest) {
+                    size_t lb = std::max(iv.lb, r[0]), rb = std::min(iv.rb, r[1]);
+                    if ( lb <= iv.idx and iv.idx < rb ) { // the maximum lies in r
+                        iv.lb = lb; iv.rb = rb;
+                        push(iv);
+                    } else {
+                        push_interval(lb, rb);
+                    }
+                }
+            }
+            while ( res[i].size() < k and !heap.empty() ) {
+                std::pop_heap(heap.begin(), heap.end(), less);
+                t_interval iv = heap.back();
+                heap.pop_back();
+                res[i].push_back(iv.idx);
+                push_interval(iv.lb, iv.idx);
+                push_interval(iv.idx+1, iv.rb);
+            }
+            enclosing.push_back({r, i, heap});
+        }
+        return res;
     }
 
     // helper struct for edge label
@@ -121,6 +568,19 @@ namespace topkcomp{
         }
     };
 
+    // Store the labels of a trie, which are built in plain, in t_label.
+    // Besides int_vector<8> t_label can be a wavelet tree over bytes,
+    // e.g. sdsl::wt_huff<>, which uses about H_0 bits per character and
+    // answers the random accesses of edge_rac in O(H_0) time.
+    template<typename t_label>
+    void construct_labels(t_label& labels, sdsl::int_vector<8>& plain) {
+        sdsl::construct_im(labels, plain, 0);
+    }
+
+    inline void construct_labels(sdsl::int_vector<8>& labels, sdsl::int_vector<8>& plain) {
+        labels.swap(plain);
+    }
+
     // constant space random access container for id function
     struct id_rac{
         typedef size_t value_type;
@@ -144,4 +604,56 @@ namespace topkcomp{
         }
     };
 
+    // Check if t_index supports typo tolerant queries via top_k_fuzzy
+    template<typename t_index, typename = void>
+    struct supports_fuzzy_search : std::false_type {};
+
+    template<typename t_index>
+    struct supports_fuzzy_search<t_index,
+        decltype(std::declval<const t_index&>().top_k_fuzzy(std::string(), 1, 1), void())> : std::true_type {};
+
+    // Check if t_index decodes results into a result_arena via
+    // top_k(prefix, k, arena)
+    template<typename t_index, typename = void>
+    struct supports_arena : std::false_type {};
+
+    template<typename t_index>
+    struct supports_arena<t_index,
+        decltype(std::declval<const t_index&>().top_k(std::string(), 1,
+                     std::declval<result_arena&>()), void())> : std::true_type {};
+
+    // Check if t_index reports results one by one via top_k_stream
+    template<typename t_index, typename = void>
+    struct supports_streaming : std::false_type {};
+
+    template<typename t_index>
+    struct supports_streaming<t_index,
+        decltype(std::declval<const t_index&>().top_k_stream(std::string(), 1,
+                     std::declval<typename t_index::cursor_type&>(),
+                     std::declval<void(*)(const std::string&, uint64_t)>()), void())> : std::true_type {};
+
+    template<typename t_index, typename t_out>
+    void top_k_stream(const t_index& index, const std::string& prefix, size_t k,
+                      typename t_index::cursor_type& cursor, t_out out, std::true_type) {
+        index.top_k_stream(prefix, k, cursor, out);
+    }
+
+    template<typename t_index, typename t_out>
+    void top_k_stream(const t_index& index, const std::string& prefix, size_t k,
+                      typename t_index::cursor_type& cursor, t_out out, std::false_type) {
+        for (const auto& sw : index.top_k(prefix, k, cursor)) {
+            out(sw.first, sw.second);
+        }
+    }
+
+    // Call out(string, weight) for the top-k of prefix in order of
+    // decreasing weight. Indexes with a member top_k_stream report each
+    // result as soon as it is selected, for the others the complete list
+    // is computed first.
+    template<typename t_index, typename t_out>
+    void top_k_stream(const t_index& index, const std::string& prefix, size_t k,
+                      typename t_index::cursor_type& cursor, t_out out) {
+        top_k_stream(index, prefix, k, cursor, out, supports_streaming<t_index>());
+    }
+
 } // end namespace topkcomp
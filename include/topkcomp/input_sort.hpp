@@ -0,0 +1,446 @@
+#pragma once
+
+#include "index_common.hpp"
+#include "case_fold.hpp"
+#include <string>
+#include <vector>
+#include <fstream>
+#include <thread>
+#include <queue>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <iostream>
+#include <unistd.h>
+
+namespace topkcomp {
+
+    // Parameters of the input pipeline of generate_index_from_file
+    struct input_options {
+        // number of threads which parse and sort the input
+        size_t   threads = std::max(1U, std::thread::hardware_concurrency());
+        // maximal number of input bytes which are sorted in memory. Larger
+        // inputs are sorted in runs which are spilled to disk and merged.
+        uint64_t memory_budget = 1ULL << 30;
+        // directory in which a private directory for the temporary run
+        // files is created; default: $TMPDIR or /tmp
+        std::string tmp_dir = "";
+    };
+
+    // Entry of the input sort: a (string, weight)-pair and, if the fold
+    // of the index is not the identity, its precomputed search key. Entries
+    // are ordered by key and then by the complete pair, so each string is
+    // folded once and not on every comparison.
+    template<typename t_fold, bool t_identity = t_fold::identity>
+    struct sort_entry {
+        std::string key;
+        tPSU        sw;
+
+        explicit sort_entry(tPSU&& f_sw) : key(t_fold::key(f_sw.first)), sw(std::move(f_sw)) {}
+
+        bool operator<(const sort_entry& e) const {
+            return std::tie(key, sw) < std::tie(e.key, e.sw);
+        }
+
+        // Check if both entries represent the same string of the index
+        bool same_string(const sort_entry& e) const {
+            return key == e.key;
+        }
+    };
+
+    template<typename t_fold>
+    struct sort_entry<t_fold, true> {
+        tPSU sw;
+
+        explicit sort_entry(tPSU&& f_sw) : sw(std::move(f_sw)) {}
+
+        bool operator<(const sort_entry& e) const {
+            return sw < e.sw;
+        }
+
+        bool same_string(const sort_entry& e) const {
+            return sw.first == e.sw.first;
+        }
+    };
+
+    // Convert (string, weight)-pairs into sort entries
+    template<typename t_fold>
+    std::vector<sort_entry<t_fold>> make_sort_entries(tVPSU&& string_weight) {
+        std::vector<sort_entry<t_fold>> entries;
+        entries.reserve(string_weight.size());
+        for (auto& sw : string_weight) {
+            entries.emplace_back(std::move(sw));
+        }
+        tVPSU().swap(string_weight);
+        return entries;
+    }
+
+    // Convert sort entries back into (string, weight)-pairs
+    template<typename t_fold>
+    tVPSU strip_sort_entries(std::vector<sort_entry<t_fold>>&& entries) {
+        tVPSU string_weight;
+        string_weight.reserve(entries.size());
+        for (auto& e : entries) {
+            string_weight.push_back(std::move(e.sw));
+        }
+        std::vector<sort_entry<t_fold>>().swap(entries);
+        return string_weight;
+    }
+
+    // Sort (string, weight)-pairs in the order of an index with fold t_fold
+    template<typename t_fold>
+    void sort_input(tVPSU& string_weight) {
+        auto entries = make_sort_entries<t_fold>(std::move(string_weight));
+        std::sort(entries.begin(), entries.end());
+        string_weight = strip_sort_entries<t_fold>(std::move(entries));
+    }
+
+    // Parse the lines `string\tweight` of buffer [begin, end)
+    inline void parse_lines(const char* begin, const char* end, tVPSU& string_weight) {
+        while ( begin < end ) {
+            const char* eol = std::find(begin, end, '\n');
+            const char* tab = std::find(begin, eol, '\t');
+            if ( tab != eol ) {
+                string_weight.emplace_back(std::string(begin, tab),
+                                           std::strtoull(tab+1, nullptr, 10));
+            }
+            begin = eol+1;
+        }
+    }
+
+    // Parse buffer with `threads` threads and sort the result. Each thread
+    // parses and sorts a part of the buffer, the parts are then merged
+    // pairwise in parallel.
+    template<typename t_fold>
+    std::vector<sort_entry<t_fold>> parse_and_sort(const std::string& buf, size_t threads) {
+        typedef std::vector<sort_entry<t_fold>> t_entries;
+        // split buffer at line ends
+        std::vector<size_t> bounds = {0};
+        for (size_t t=1; t < threads; ++t) {
+            size_t pos = std::max(bounds.back(), t*buf.size()/threads);
+            pos = std::min(buf.find('\n', pos), buf.size());
+            bounds.push_back(pos == buf.size() ? pos : pos+1);
+        }
+        bounds.push_back(buf.size());
+        std::vector<t_entries> parts(bounds.size()-1);
+        std::vector<std::thread> workers;
+        for (size_t t=0; t < parts.size(); ++t) {
+            workers.emplace_back([&, t](){
+                tVPSU string_weight;
+                parse_lines(buf.data()+bounds[t], buf.data()+bounds[t+1], string_weight);
+                parts[t] = make_sort_entries<t_fold>(std::move(string_weight));
+                std::sort(parts[t].begin(), parts[t].end());
+            });
+        }
+        for (auto& w : workers) w.join();
+        // merge neighbouring parts until one is left
+        while ( parts.size() > 1 ) {
+            std::vector<t_entries> merged((parts.size()+1)/2);
+            workers.clear();
+            for (size_t t=0; t < merged.size(); ++t) {
+                workers.emplace_back([&, t](){
+                    if ( 2*t+1 == parts.size() ) {
+                        merged[t] = std::move(parts[2*t]);
+                        return;
+                    }
+                    auto& a = parts[2*t];
+                    auto& b = parts[2*t+1];
+                    merged[t].reserve(a.size()+b.size());
+                    std::merge(std::make_move_iterator(a.begin()), std::make_move_iterator(a.end()),
+                               std::make_move_iterator(b.begin()), std::make_move_iterator(b.end()),
+                               std::back_inserter(merged[t]));
+                    t_entries().swap(a); t_entries().swap(b);
+                });
+            }
+            for (auto& w : workers) w.join();
+            parts = std::move(merged);
+        }
+        return parts.empty() ? t_entries() : std::move(parts[0]);
+    }
+
+    // Remove all but the first entry of each string from sorted entries
+    template<typename t_fold>
+    void remove_duplicates(std::vector<sort_entry<t_fold>>& entries) {
+        auto unique_end = std::unique(entries.begin(), entries.end(),
+                                      [](const sort_entry<t_fold>& a, const sort_entry<t_fold>& b){
+                                          return a.same_string(b);
+                                      });
+        entries.erase(unique_end, entries.end());
+    }
+
+    // Estimated memory of the sort entries of a line of len bytes: the
+    // entry is moved between two vectors while the parts are merged, and
+    // the string and its key live on the heap unless they are short.
+    template<typename t_fold>
+    uint64_t parsed_size(size_t len) {
+        uint64_t heap = len >= 16 ? len+1 : 0;
+        return 2*sizeof(sort_entry<t_fold>) + (t_fold::identity ? heap : 2*heap);
+    }
+
+    // The (string, weight)-pairs of a file, sorted and without duplicate
+    // strings; strings are ordered and identified by their keys under the
+    // fold which is passed to the constructor. The file is processed in
+    // runs whose size plus the size of their parsed entries is at most
+    // opt.memory_budget. If there is more than one run, each sorted run is
+    // written to a private temporary directory and the runs are merged
+    // into one file there. for_each then streams the pairs from that
+    // file, so they never have to fit into memory at once.
+    class sorted_input {
+        tVPSU       m_pairs;             // the pairs if there is one run
+        std::string m_dir;               // temporary directory or empty
+        std::string m_merged;            // merged runs or empty
+        tTUUU       m_stats{0, 0, 0};    // see input_stats
+
+        public:
+            template<typename t_fold>
+            sorted_input(const std::string& file, t_fold, const input_options& opt=input_options()) {
+                std::ifstream in(file.c_str(), std::ios::binary);
+                if ( !in ) {
+                    return;
+                }
+                uint64_t budget = std::max<uint64_t>(opt.memory_budget, 1);
+                std::vector<std::string> run_files;
+                std::vector<sort_entry<t_fold>> entries;
+                std::string buf, rest;
+                bool eof = false;
+                auto read = [&](size_t len) {
+                    size_t old = buf.size();
+                    buf.resize(old+len);
+                    in.read(&buf[old], len);
+                    buf.resize(old+in.gcount());
+                    eof = !in;
+                };
+                while ( !eof or !rest.empty() ) {
+                    // read the next run; a partial last line is moved to the next run
+                    buf.swap(rest);
+                    rest.clear();
+                    if ( !eof and buf.size() < budget ) {
+                        read(budget-buf.size());
+                    }
+                    // a line longer than the budget: double the buffer until it ends
+                    for (size_t searched = 0; !eof and buf.find('\n', searched) == std::string::npos; ) {
+                        searched = buf.size();
+                        read(std::max<size_t>(buf.size(), 1));
+                    }
+                    // cut after the last complete line which fits into the budget
+                    size_t cut = 0;
+                    uint64_t used = 0;
+                    while ( cut < buf.size() ) {
+                        size_t eol = buf.find('\n', cut);
+                        if ( eol == std::string::npos and !eof ) {
+                            break; // partial line
+                        }
+                        size_t next = eol == std::string::npos ? buf.size() : eol+1;
+                        used += (next-cut) + parsed_size<t_fold>(next-cut);
+                        if ( used > budget and cut > 0 ) {
+                            break;
+                        }
+                        cut = next;
+                    }
+                    rest.assign(buf, cut, std::string::npos);
+                    buf.resize(cut);
+                    bool last = eof and rest.empty();
+                    if ( !last and m_dir.empty() and !make_dir(opt.tmp_dir) ) {
+                        // sort in memory
+                        buf += rest;
+                        rest.clear();
+                        while ( !eof ) {
+                            read(std::max<size_t>(buf.size(), budget));
+                        }
+                        last = true;
+                    }
+                    entries = parse_and_sort<t_fold>(buf, opt.threads);
+                    std::string().swap(buf);
+                    remove_duplicates(entries);
+                    if ( !last or !run_files.empty() ) { // spill run to disk
+                        run_files.push_back(m_dir + "/run" + std::to_string(run_files.size()));
+                        std::ofstream out(run_files.back().c_str(), std::ios::binary);
+                        for (const auto& e : entries) {
+                            out << e.sw.first << '\t' << e.sw.second << '\n';
+                        }
+                        std::vector<sort_entry<t_fold>>().swap(entries);
+                    }
+                }
+                if ( run_files.empty() ) {
+                    m_pairs = strip_sort_entries<t_fold>(std::move(entries));
+                    if ( !m_pairs.empty() ) {
+                        m_stats = input_stats(m_pairs);
+                    }
+                    return;
+                }
+                merge_runs<t_fold>(run_files);
+            }
+
+            sorted_input(const sorted_input&) = delete;
+            sorted_input& operator=(const sorted_input&) = delete;
+
+            sorted_input(sorted_input&& s) : m_pairs(std::move(s.m_pairs)), m_dir(std::move(s.m_dir)),
+                m_merged(std::move(s.m_merged)), m_stats(s.m_stats) {
+                s.m_dir.clear();
+                s.m_merged.clear();
+            }
+
+            ~sorted_input() {
+                if ( !m_merged.empty() ) {
+                    std::remove(m_merged.c_str());
+                }
+                if ( !m_dir.empty() ) {
+                    rmdir(m_dir.c_str());
+                }
+            }
+
+            // Number of pairs
+            size_t size() const {
+                return std::get<0>(m_stats);
+            }
+
+            bool empty() const {
+                return size() == 0;
+            }
+
+            // See input_stats
+            const tTUUU& stats() const {
+                return m_stats;
+            }
+
+            // Call f(i, string, weight) for the pairs in sorted order
+            template<typename t_f>
+            void for_each(t_f f) const {
+                if ( m_merged.empty() ) {
+                    for_each_pair(m_pairs, f);
+                    return;
+                }
+                std::ifstream in(m_merged.c_str(), std::ios::binary);
+                std::string line;
+                for (size_t i=0; std::getline(in, line); ++i) {
+                    size_t tab = line.find('\t');
+                    uint64_t weight = std::strtoull(line.c_str()+tab+1, nullptr, 10);
+                    line.resize(tab);
+                    f(i, line, weight);
+                }
+            }
+
+            // Return the pairs as list; the input is empty afterwards
+            tVPSU release() {
+                tVPSU res;
+                if ( m_merged.empty() ) {
+                    res.swap(m_pairs);
+                } else {
+                    res.reserve(size());
+                    for_each([&](size_t, const std::string& s, uint64_t w) {
+                        res.emplace_back(s, w);
+                    });
+                }
+                m_stats = tTUUU(0, 0, 0);
+                return res;
+            }
+
+        private:
+
+            // Create a private directory for the run files in tmp_dir
+            bool make_dir(std::string tmp_dir) {
+                if ( tmp_dir.empty() ) {
+                    const char* env = std::getenv("TMPDIR");
+                    tmp_dir = env != nullptr ? env : "/tmp";
+                }
+                std::string dir = tmp_dir + "/topkcomp.XXXXXX";
+                if ( mkdtemp(&dir[0]) == nullptr ) {
+                    std::cerr << "Error: Could not create a temporary directory in " << tmp_dir;
+                    std::cerr << "; the input is sorted in memory." << std::endl;
+                    return false;
+                }
+                m_dir = dir;
+                return true;
+            }
+
+            // Merge the sorted runs into one file without duplicates. At most
+            // max_fan_in runs are open at once; if there are more, groups of
+            // them are merged into longer runs first.
+            template<typename t_fold>
+            void merge_runs(std::vector<std::string> run_files) {
+                const size_t max_fan_in = 64;
+                size_t merges = 0;
+                while ( run_files.size() > max_fan_in ) {
+                    std::vector<std::string> merged;
+                    for (size_t r=0; r < run_files.size(); r += max_fan_in) {
+                        std::vector<std::string> group(run_files.begin()+r,
+                            run_files.begin()+std::min(r+max_fan_in, run_files.size()));
+                        merged.push_back(m_dir + "/merge" + std::to_string(merges++));
+                        merge_files<t_fold>(group, merged.back());
+                    }
+                    run_files.swap(merged);
+                }
+                m_merged = m_dir + "/merged";
+                m_stats = merge_files<t_fold>(run_files, m_merged);
+            }
+
+            // k-way merge of sorted runs into file out without duplicates;
+            // the runs are removed
+            // \returns The input statistics of the merged run
+            template<typename t_fold>
+            static tTUUU merge_files(const std::vector<std::string>& run_files, const std::string& out_file) {
+                struct run_head {
+                    sort_entry<t_fold> entry;
+                    size_t             run;
+                };
+                auto greater = [&](const run_head& a, const run_head& b) {
+                    return b.entry < a.entry or (!(a.entry < b.entry) and a.run > b.run);
+                };
+                std::priority_queue<run_head, std::vector<run_head>, decltype(greater)> heads(greater);
+                std::vector<std::ifstream> runs(run_files.size());
+                auto next = [&](size_t r) {
+                    std::string line;
+                    if ( std::getline(runs[r], line) ) {
+                        tVPSU entry;
+                        parse_lines(line.data(), line.data()+line.size(), entry);
+                        if ( !entry.empty() )
+                            heads.push({sort_entry<t_fold>(std::move(entry[0])), r});
+                    }
+                };
+                for (size_t r=0; r < runs.size(); ++r) {
+                    runs[r].open(run_files[r].c_str(), std::ios::binary);
+                    next(r);
+                }
+                std::ofstream out(out_file.c_str(), std::ios::binary);
+                uint64_t N = 0, n = 0, max_weight = 0;
+                std::vector<sort_entry<t_fold>> prev; // last written entry
+                while ( !heads.empty() ) {
+                    auto head = heads.top();
+                    heads.pop();
+                    if ( prev.empty() or !prev[0].same_string(head.entry) ) {
+                        const tPSU& sw = head.entry.sw;
+                        out << sw.first << '\t' << sw.second << '\n';
+                        ++N;
+                        n += sw.first.size();
+                        max_weight = std::max(max_weight, sw.second);
+                        prev.clear();
+                        prev.push_back(std::move(head.entry));
+                    }
+                    next(head.run);
+                }
+                for (size_t r=0; r < runs.size(); ++r) {
+                    runs[r].close();
+                    std::remove(run_files[r].c_str());
+                }
+                return tTUUU(N, n, max_weight);
+            }
+    };
+
+    inline tTUUU input_stats(const sorted_input& input) {
+        return input.stats();
+    }
+
+    template<typename t_f>
+    void for_each_pair(const sorted_input& input, t_f f) {
+        input.for_each(f);
+    }
+
+    // Read the (string, weight)-pairs of file and return them sorted and
+    // without duplicate strings (see sorted_input)
+    template<typename t_fold>
+    tVPSU read_sorted_input(const std::string& file, const input_options& opt=input_options()) {
+        return sorted_input(file, t_fold(), opt).release();
+    }
+
+} // end namespace topkcomp
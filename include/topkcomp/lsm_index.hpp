@@ -0,0 +1,330 @@
+#pragma once
+
+#include "index_common.hpp"
+#include "input_sort.hpp"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+#include <queue>
+#include <tuple>
+#include <type_traits>
+
+namespace topkcomp {
+
+// Check if t_index can pass over given strings in top-k queries: it
+// finds the index of a string and answers top_k(prefix, k, skip) for a
+// sorted list skip of indexes
+template<typename t_index, typename = void>
+struct supports_skip : std::false_type {};
+
+template<typename t_index>
+struct supports_skip<t_index,
+    decltype(std::declval<const t_index&>().find_string(std::string()),
+             std::declval<const t_index&>().top_k(std::string(), size_t(), tVU()), void())> : std::true_type {};
+
+// Top-k completion index which accepts insertions and deletions. It
+// consists of two tiers: a static index of type t_index and a small
+// sorted delta of recently inserted and deleted strings. Queries merge
+// the top-k of both tiers. merge() builds a new static index of both
+// tiers in the background and swaps it in, queries are answered by the
+// old static index and the delta in the meantime.
+template<typename t_index>
+class lsm_index {
+    // A string of the delta; deleted strings are kept as tombstones,
+    // which hide the string in the static index
+    struct delta_entry {
+        std::string str;
+        uint64_t    weight;
+        bool        deleted;
+        size_t      static_idx; // index of the hidden string in the static index or npos
+
+        bool operator==(const delta_entry& e) const {
+            return str == e.str and weight == e.weight and deleted == e.deleted;
+        }
+    };
+    // the delta is ordered by the search key of the strings
+    typedef std::map<std::string, delta_entry> t_delta;
+
+    std::shared_ptr<const t_index> m_static;
+    t_delta                        m_delta;
+    mutable std::mutex             m_mutex;       // protects m_static and m_delta
+    std::mutex                     m_merge_mutex; // serializes merges
+
+    public:
+        typedef size_t size_type;
+        constexpr static size_t npos = (size_t)-1;
+        typedef no_cursor cursor_type;
+        constexpr static bool case_sensitive = t_index::case_sensitive;
+        typedef typename index_fold<t_index>::type fold_type;
+
+        // Constructor takes a sorted list of (string,weight)-pairs
+        lsm_index(const tVPSU& string_weight=tVPSU()) :
+            m_static(std::make_shared<const t_index>(string_weight)) {}
+
+        // Number of strings in the static index
+        size_type size() const {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_static->size();
+        }
+
+        // Number of inserted and deleted strings which are not merged
+        size_type delta_size() const {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_delta.size();
+        }
+
+        // k > 0; the k heaviest live delta strings are kept in a bounded
+        // heap and merged with the top-k of the static index. On equal
+        // weights delta strings come first, in key order.
+        tVPSU top_k(const std::string& prefix, size_t k) const {
+            std::shared_ptr<const t_index> static_index;
+            std::vector<std::string> shadowed; // keys of delta strings matching prefix
+            tVU shadowed_idx;                  // their indexes in the static index
+            tVPSU delta_list;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                static_index = m_static;
+                // (weight, position in key order, entry); the top is the
+                // lightest entry, on equal weights the last one
+                typedef std::tuple<uint64_t, size_t, const delta_entry*> t_heap_entry;
+                auto heavier = [](const t_heap_entry& a, const t_heap_entry& b) {
+                    return std::get<0>(a) > std::get<0>(b) or
+                           (std::get<0>(a) == std::get<0>(b) and std::get<1>(a) < std::get<1>(b));
+                };
+                std::priority_queue<t_heap_entry, std::vector<t_heap_entry>, decltype(heavier)> heap(heavier);
+                std::string p = key(prefix);
+                size_t pos = 0;
+                for (auto it = m_delta.lower_bound(p);
+                     it != m_delta.end() and it->first.compare(0, p.size(), p) == 0; ++it) {
+                    shadowed.push_back(it->first);
+                    if ( it->second.static_idx != npos ) {
+                        shadowed_idx.push_back(it->second.static_idx);
+                    }
+                    if ( !it->second.deleted ) {
+                        if ( heap.size() < k ) {
+                            heap.emplace(it->second.weight, pos, &it->second);
+                        } else if ( it->second.weight > std::get<0>(heap.top()) ) {
+                            heap.pop();
+                            heap.emplace(it->second.weight, pos, &it->second);
+                        }
+                        ++pos;
+                    }
+                }
+                delta_list.resize(heap.size());
+                for (size_t i = heap.size(); i > 0; --i) {
+                    delta_list[i-1] = tPSU(std::get<2>(heap.top())->str, std::get<0>(heap.top()));
+                    heap.pop();
+                }
+            }
+            if ( static_index->size() == 0 ) {
+                return delta_list;
+            }
+            auto static_list = static_top_k(*static_index, prefix, k, shadowed, shadowed_idx,
+                                            supports_skip<t_index>());
+            tVPSU result_list;
+            result_list.reserve(std::min(k, delta_list.size() + static_list.size()));
+            auto d = delta_list.begin(), s = static_list.begin();
+            while ( result_list.size() < k and (d != delta_list.end() or s != static_list.end()) ) {
+                if ( s == static_list.end() or (d != delta_list.end() and d->second >= s->second) ) {
+                    result_list.push_back(std::move(*d++));
+                } else {
+                    result_list.push_back(std::move(*s++));
+                }
+            }
+            return result_list;
+        }
+
+        // k > 0; the static index may be swapped between two queries,
+        // so there is no search state to resume
+        tVPSU top_k(const std::string& prefix, size_t k, cursor_type&) const {
+            return top_k(prefix, k);
+        }
+
+        // Answer top-k queries for several prefixes at once
+        std::vector<tVPSU> top_k_batch(const std::vector<std::string>& prefixes, size_t k) const {
+            return topkcomp::top_k_batch(*this, prefixes, k);
+        }
+
+        // Insert (string, weight)-pairs; the weight of a contained string
+        // is replaced. The strings are visible to the next query.
+        void insert(const tVPSU& string_weight) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (const auto& sw : string_weight) {
+                m_delta[key(sw.first)] = delta_entry{sw.first, sw.second, false, static_index_of(sw.first)};
+            }
+        }
+
+        // Delete strings; strings which are not contained are ignored.
+        // A string which is neither in the delta nor, as far as the
+        // static index can tell, in the static index gets no tombstone.
+        void erase(const std::vector<std::string>& strings) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (const auto& s : strings) {
+                std::string k = key(s);
+                size_t static_idx = static_index_of(s);
+                if ( supports_skip<t_index>::value and static_idx == npos and m_delta.count(k) == 0 ) {
+                    continue;
+                }
+                m_delta[k] = delta_entry{s, 0, true, static_idx};
+            }
+        }
+
+        // Build a new static index of the static index and the delta and
+        // swap it in. Queries, insertions and deletions may run
+        // concurrently; they see the old static index and the complete
+        // delta until the swap. Changes of the delta during the
+        // construction are kept for the next merge.
+        void merge() {
+            std::lock_guard<std::mutex> merge_lock(m_merge_mutex);
+            std::shared_ptr<const t_index> static_index;
+            t_delta delta;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                static_index = m_static;
+                delta = m_delta;
+            }
+            if ( delta.empty() ) {
+                return;
+            }
+            // all strings of the static index are the top-k of the empty prefix
+            tVPSU string_weight;
+            if ( static_index->size() > 0 ) {
+                for (auto& sw : static_index->top_k("", static_index->size())) {
+                    if ( delta.find(key(sw.first)) == delta.end() ) {
+                        string_weight.push_back(std::move(sw));
+                    }
+                }
+            }
+            for (const auto& e : delta) {
+                if ( !e.second.deleted ) {
+                    string_weight.emplace_back(e.second.str, e.second.weight);
+                }
+            }
+            sort_input<fold_type>(string_weight);
+            auto new_static = std::make_shared<const t_index>(string_weight);
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_static = new_static;
+            for (const auto& e : delta) {
+                auto it = m_delta.find(e.first);
+                if ( it != m_delta.end() and it->second == e.second ) {
+                    m_delta.erase(it);
+                }
+            }
+            // the remaining changes hide strings of the new static index
+            for (auto& e : m_delta) {
+                e.second.static_idx = static_index_of(e.second.str);
+            }
+        }
+
+        // Serialize method
+        size_type
+        serialize(std::ostream& out, sdsl::structure_tree_node* v=nullptr,
+                  std::string name="") const {
+            using namespace sdsl;
+            auto child = structure_tree::add_child(v, name, util::class_name(*this));
+            std::shared_ptr<const t_index> static_index;
+            t_delta delta;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                static_index = m_static;
+                delta = m_delta;
+            }
+            size_type written_bytes = 0;
+            written_bytes += static_index->serialize(out, child, "static");
+            auto delta_child = structure_tree::add_child(child, "delta", "delta");
+            size_type delta_bytes = write_member((uint64_t)delta.size(), out);
+            for (const auto& e : delta) {
+                delta_bytes += write_member(e.second.str, out);
+                delta_bytes += write_member(e.second.weight, out);
+                delta_bytes += write_member((uint8_t)e.second.deleted, out);
+            }
+            structure_tree::add_size(delta_child, delta_bytes);
+            written_bytes += delta_bytes;
+            structure_tree::add_size(child, written_bytes);
+            return written_bytes;
+        }
+
+        // Load method
+        void load(std::istream& in) {
+            using namespace sdsl;
+            auto static_index = std::make_shared<t_index>();
+            static_index->load(in);
+            t_delta delta;
+            uint64_t delta_size = 0;
+            read_member(delta_size, in);
+            for (uint64_t i=0; i < delta_size; ++i) {
+                delta_entry e;
+                uint8_t deleted = 0;
+                read_member(e.str, in);
+                read_member(e.weight, in);
+                read_member(deleted, in);
+                e.deleted = deleted;
+                delta[key(e.str)] = e;
+            }
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_static = static_index;
+            m_delta.swap(delta);
+            for (auto& e : m_delta) {
+                e.second.static_idx = static_index_of(e.second.str);
+            }
+        }
+
+    private:
+
+        // Top-k of the static index without the strings which are
+        // shadowed by the delta. The rmq enumeration passes over the
+        // indexes of the shadowed strings, so no extra results are
+        // decoded.
+        static tVPSU static_top_k(const t_index& static_index, const std::string& prefix, size_t k,
+                                  const std::vector<std::string>&, const tVU& shadowed_idx,
+                                  std::true_type) {
+            tVU skip = shadowed_idx;
+            std::sort(skip.begin(), skip.end());
+            return static_index.top_k(prefix, k, skip);
+        }
+
+        // Indexes without skip support: each shadowed string can hide
+        // one result of the static index, so as many extra results are
+        // fetched and filtered
+        static tVPSU static_top_k(const t_index& static_index, const std::string& prefix, size_t k,
+                                  const std::vector<std::string>& shadowed, const tVU&,
+                                  std::false_type) {
+            tVPSU result_list;
+            for (auto& sw : static_index.top_k(prefix, k+shadowed.size())) {
+                if ( !std::binary_search(shadowed.begin(), shadowed.end(), key(sw.first)) ) {
+                    result_list.push_back(std::move(sw));
+                }
+            }
+            return result_list;
+        }
+
+        // Index of s in the static index or npos; m_mutex is held
+        size_t static_index_of(const std::string& s) const {
+            return static_index_of(s, supports_skip<t_index>());
+        }
+
+        size_t static_index_of(const std::string& s, std::true_type) const {
+            return m_static->size() > 0 ? m_static->find_string(s) : npos;
+        }
+
+        size_t static_index_of(const std::string&, std::false_type) const {
+            return npos;
+        }
+
+        // Search key of s in the delta; case insensitive indexes match
+        // prefixes regardless of case
+        static std::string key(const std::string& s) {
+            return fold_type::key(s);
+        }
+};
+
+// Check if t_index supports insertions and deletions
+template<typename t_index, typename = void>
+struct supports_insertions : std::false_type {};
+
+template<typename t_index>
+struct supports_insertions<t_index,
+    decltype(std::declval<t_index&>().insert(tVPSU()), void())> : std::true_type {};
+
+} // end namespace topkcomp
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <string>
+
+namespace topkcomp {
+
+    // Histogram of latencies. Bucket i counts the latencies of at most
+    // 2^i microseconds, the last bucket all others. Updates are relaxed
+    // atomic increments, so one histogram can be shared by all query
+    // threads without locks.
+    class latency_histogram {
+        public:
+            static constexpr size_t buckets = 22; // 1us, 2us, ..., 2^20us, +Inf
+
+            void record(uint64_t ns) {
+                size_t b = 0;
+                while ( b+1 < buckets and (1000ULL << b) < ns ) {
+                    ++b;
+                }
+                m_count[b].fetch_add(1, std::memory_order_relaxed);
+                m_sum_ns.fetch_add(ns, std::memory_order_relaxed);
+            }
+
+            // Write histogram in Prometheus text format; labels is either
+            // empty or a list like `stage="label"`
+            void write(std::ostream& out, const std::string& name, const std::string& labels) const {
+                std::string sep = labels.empty() ? "" : ",";
+                uint64_t cumulative = 0;
+                for (size_t b=0; b < buckets; ++b) {
+                    cumulative += m_count[b].load(std::memory_order_relaxed);
+                    out << name << "_bucket{" << labels << sep << "le=\"";
+                    if ( b+1 < buckets ) {
+                        out << (1ULL << b) / 1e6;
+                    } else {
+                        out << "+Inf";
+                    }
+                    out << "\"} " << cumulative << "\n";
+                }
+                std::string braces = labels.empty() ? "" : "{" + labels + "}";
+                out << name << "_sum" << braces << " " << m_sum_ns.load(std::memory_order_relaxed) / 1e9 << "\n";
+                out << name << "_count" << braces << " " << cumulative << "\n";
+            }
+
+        private:
+            std::array<std::atomic<uint64_t>, buckets> m_count{};
+            std::atomic<uint64_t>                      m_sum_ns{0};
+    };
+
+    // Records the time between its construction and destruction, without
+    // the time between pause() and resume(). Started paused, it records
+    // only the time between resume() and pause().
+    class stage_timer {
+            typedef std::chrono::steady_clock clock;
+            latency_histogram& m_histogram;
+            clock::time_point  m_start;
+            clock::duration    m_elapsed{0}; // time before the last pause
+            bool               m_running;
+        public:
+            stage_timer(latency_histogram& histogram, bool running=true) :
+                m_histogram(histogram), m_start(clock::now()), m_running(running) {}
+
+            void pause() {
+                m_elapsed += clock::now() - m_start;
+                m_running = false;
+            }
+
+            void resume() {
+                m_start = clock::now();
+                m_running = true;
+            }
+
+            ~stage_timer() {
+                if ( m_running ) {
+                    pause();
+                }
+                m_histogram.record(std::chrono::duration_cast<std::chrono::nanoseconds>(m_elapsed).count());
+            }
+    };
+
+    // Stage latencies and counters of the index classes. They are only
+    // updated if compiled with TOPKCOMP_METRICS.
+    struct query_metrics {
+        latency_histogram     prefix_range;              // search of the matching range
+        latency_histogram     heaviest_indexes_in_range; // selection of the top-k
+        latency_histogram     label;                     // reconstruction of the strings
+        std::atomic<uint64_t> cache_hits{0};             // queries answered by topk_cache
+
+        void write(std::ostream& out) const {
+            out << "# HELP topkcomp_stage_seconds Latency of the stages of a top-k query.\n";
+            out << "# TYPE topkcomp_stage_seconds histogram\n";
+            prefix_range.write(out, "topkcomp_stage_seconds", "stage=\"prefix_range\"");
+            heaviest_indexes_in_range.write(out, "topkcomp_stage_seconds", "stage=\"heaviest_indexes_in_range\"");
+            label.write(out, "topkcomp_stage_seconds", "stage=\"label\"");
+            out << "# HELP topkcomp_cache_hits_total Queries answered from precomputed top-k lists.\n";
+            out << "# TYPE topkcomp_cache_hits_total counter\n";
+            out << "topkcomp_cache_hits_total " << cache_hits.load(std::memory_order_relaxed) << "\n";
+        }
+    };
+
+    // The process wide metrics of the index classes
+    inline query_metrics& metrics() {
+        static query_metrics m;
+        return m;
+    }
+
+} // end namespace topkcomp
+
+#ifdef TOPKCOMP_METRICS
+// Time the rest of the enclosing scope as the given stage of query_metrics
+#define TOPKCOMP_STAGE_TIMER(stage) \
+    topkcomp::stage_timer stage_timer_##stage(topkcomp::metrics().stage)
+// Like TOPKCOMP_STAGE_TIMER, but the timer only runs after a resume
+#define TOPKCOMP_STAGE_TIMER_PAUSED(stage) \
+    topkcomp::stage_timer stage_timer_##stage(topkcomp::metrics().stage, false)
+// Stop and restart the timer of the given stage in the enclosing scope
+#define TOPKCOMP_STAGE_PAUSE(stage) stage_timer_##stage.pause()
+#define TOPKCOMP_STAGE_RESUME(stage) stage_timer_##stage.resume()
+// Increment the given counter of query_metrics
+#define TOPKCOMP_COUNT(counter) \
+    topkcomp::metrics().counter.fetch_add(1, std::memory_order_relaxed)
+#else
+#define TOPKCOMP_STAGE_TIMER(stage)
+#define TOPKCOMP_STAGE_TIMER_PAUSED(stage)
+#define TOPKCOMP_STAGE_PAUSE(stage)
+#define TOPKCOMP_STAGE_RESUME(stage)
+#define TOPKCOMP_COUNT(counter)
+#endif
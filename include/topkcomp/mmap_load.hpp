@@ -0,0 +1,240 @@
+#pragma once
+
+#include <sdsl/int_vector.hpp>
+#include <sdsl/util.hpp>
+#include <algorithm>
+#include <cstring>
+#include <istream>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace topkcomp {
+
+// Read-only memory mapping of a file. The pages are shared with all
+// processes which map the same file and are read on first access.
+class mapped_file {
+    const char* m_data = nullptr;
+    size_t      m_size = 0;
+
+    public:
+        explicit mapped_file(const std::string& file) {
+            int fd = open(file.c_str(), O_RDONLY);
+            if ( fd < 0 ) {
+                return;
+            }
+            struct stat st;
+            if ( fstat(fd, &st) == 0 and st.st_size > 0 ) {
+                void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+                if ( p != MAP_FAILED ) {
+                    m_data = (const char*)p;
+                    m_size = st.st_size;
+                }
+            }
+            close(fd);
+        }
+
+        ~mapped_file() {
+            if ( m_data != nullptr ) {
+                munmap((void*)m_data, m_size);
+            }
+        }
+
+        mapped_file(const mapped_file&) = delete;
+        mapped_file& operator=(const mapped_file&) = delete;
+
+        bool valid() const { return m_data != nullptr; }
+
+        const char* data() const { return m_data; }
+
+        size_t size() const { return m_size; }
+};
+
+// Stream buffer whose get area is a mapped file. Members which know it,
+// like mapped_int_vector, take a pointer to their data instead of
+// reading it; all other members are read from the mapping as usual.
+class mapped_streambuf : public std::streambuf {
+    std::shared_ptr<const mapped_file> m_file;
+
+    public:
+        explicit mapped_streambuf(std::shared_ptr<const mapped_file> file) : m_file(std::move(file)) {
+            char* begin = const_cast<char*>(m_file->data());
+            setg(begin, begin, begin + m_file->size());
+        }
+
+        const std::shared_ptr<const mapped_file>& file() const { return m_file; }
+
+        // Current read position in the mapping
+        const char* position() const { return gptr(); }
+
+        // Number of bytes after the read position
+        size_t available() const { return egptr() - gptr(); }
+
+        // Skip n <= available() bytes
+        void skip(size_t n) { setg(eback(), gptr() + n, egptr()); }
+
+    protected:
+        pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                         std::ios_base::openmode which = std::ios_base::in) override {
+            const char* base = dir == std::ios_base::beg ? eback() :
+                               (dir == std::ios_base::cur ? gptr() : egptr());
+            const char* p = base + off;
+            if ( !(which & std::ios_base::in) or p < eback() or p > egptr() ) {
+                return pos_type(off_type(-1));
+            }
+            setg(eback(), const_cast<char*>(p), egptr());
+            return pos_type(p - eback());
+        }
+
+        pos_type seekpos(pos_type pos, std::ios_base::openmode which = std::ios_base::in) override {
+            return seekoff(off_type(pos), std::ios_base::beg, which);
+        }
+};
+
+// Read-only int_vector whose words may live in a mapped index file. It is
+// serialized like sdsl::int_vector<t_width>, so the index files do not
+// change. Loaded from a mapped_streambuf it points into the mapping,
+// which it keeps alive, so loading costs no copy; loaded from another
+// stream it reads its words.
+template<uint8_t t_width = 0>
+class mapped_int_vector {
+    std::shared_ptr<const mapped_file> m_file;  // mapping of the words, if mapped
+    const char*                        m_mapped = nullptr;
+    std::vector<uint64_t>              m_words; // the words, if not mapped
+    uint64_t                           m_size = 0;
+    uint8_t                            m_width = t_width ? t_width : 64;
+
+    const char* words() const {
+        return m_file ? m_mapped : (const char*)m_words.data();
+    }
+
+    // Word i; mapped words are not necessarily aligned
+    uint64_t word(size_t i) const {
+        uint64_t w;
+        std::memcpy(&w, words() + 8*i, sizeof(w));
+        return w;
+    }
+
+    public:
+        typedef uint64_t value_type;
+        typedef uint64_t size_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef sdsl::random_access_const_iterator<mapped_int_vector> const_iterator;
+        typedef const_iterator iterator;
+
+        mapped_int_vector() = default;
+
+        // Copy the elements of v
+        template<uint8_t t_v_width>
+        explicit mapped_int_vector(const sdsl::int_vector<t_v_width>& v) :
+            m_size(v.size()), m_width(t_width ? t_width : v.width()) {
+            m_words.assign((m_size*m_width + 63) / 64, 0);
+            for (size_t i=0; i < m_size; ++i) {
+                uint64_t x = v[i], p = i*m_width;
+                if ( m_width < 64 ) {
+                    x &= (1ULL << m_width) - 1;
+                }
+                m_words[p >> 6] |= x << (p & 63);
+                if ( (p & 63) + m_width > 64 ) {
+                    m_words[(p >> 6) + 1] |= x >> (64 - (p & 63));
+                }
+            }
+        }
+
+        size_type size() const { return m_size; }
+
+        bool empty() const { return m_size == 0; }
+
+        uint8_t width() const { return m_width; }
+
+        // Check if the words point into a mapped file
+        bool mapped() const { return (bool)m_file; }
+
+        value_type operator[](size_type i) const {
+            if ( m_width == 8 ) {
+                return (uint8_t)words()[i];
+            }
+            uint64_t p = i*m_width;
+            uint64_t x = word(p >> 6) >> (p & 63);
+            if ( (p & 63) + m_width > 64 ) {
+                x |= word((p >> 6) + 1) << (64 - (p & 63));
+            }
+            return m_width == 64 ? x : x & ((1ULL << m_width) - 1);
+        }
+
+        const_iterator begin() const { return const_iterator(this, 0); }
+
+        const_iterator end() const { return const_iterator(this, size()); }
+
+        // Serialize method; the layout of sdsl::int_vector<t_width>: size in
+        // bits, width (variable width only) and the 64-bit words
+        size_type
+        serialize(std::ostream& out, sdsl::structure_tree_node* v=nullptr,
+                  std::string name="") const {
+            using namespace sdsl;
+            auto child = structure_tree::add_child(v, name, util::class_name(*this));
+            uint64_t bits = m_size * m_width;
+            size_type written_bytes = write_member(bits, out);
+            if ( t_width == 0 ) {
+                written_bytes += write_member(m_width, out);
+            }
+            size_t bytes = 8*((bits + 63) / 64);
+            out.write(words(), bytes);
+            written_bytes += bytes;
+            structure_tree::add_size(child, written_bytes);
+            return written_bytes;
+        }
+
+        // Load method
+        void load(std::istream& in) {
+            using namespace sdsl;
+            uint64_t bits = 0;
+            read_member(bits, in);
+            m_width = t_width;
+            if ( t_width == 0 ) {
+                read_member(m_width, in);
+            }
+            m_size = m_width ? bits / m_width : 0;
+            size_t bytes = 8*((bits + 63) / 64);
+            auto buf = dynamic_cast<mapped_streambuf*>(in.rdbuf());
+            m_words.clear();
+            if ( buf != nullptr and buf->available() >= bytes ) {
+                m_file   = buf->file();
+                m_mapped = buf->position();
+                buf->skip(bytes);
+            } else {
+                m_file.reset();
+                m_mapped = nullptr;
+                m_words.resize(bytes / 8);
+                in.read((char*)m_words.data(), bytes);
+            }
+        }
+};
+
+// Labels of a bp_trie as mapped_int_vector<8>
+inline void construct_labels(mapped_int_vector<8>& labels, sdsl::int_vector<8>& plain) {
+    labels = mapped_int_vector<8>(plain);
+}
+
+// Load index from file through a read-only memory mapping. Members of
+// type mapped_int_vector point into the mapping, all other members are
+// read from it.
+// \returns false if the file can not be mapped
+template<typename t_index>
+bool load_from_mapped_file(t_index& index, const std::string& file) {
+    auto mapping = std::make_shared<const mapped_file>(file);
+    if ( !mapping->valid() ) {
+        return false;
+    }
+    mapped_streambuf buf(mapping);
+    std::istream in(&buf);
+    index.load(in);
+    return true;
+}
+
+} // end namespace topkcomp
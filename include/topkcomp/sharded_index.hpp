@@ -0,0 +1,246 @@
+#pragma once
+
+#include "index_common.hpp"
+#include "input_sort.hpp"
+#include "http_client.hpp"
+#include <string>
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <functional>
+#include <algorithm>
+
+namespace topkcomp {
+
+// Split a sorted list of (string, weight)-pairs into num_shards parts of
+// about the same number of strings. Each part is a lexicographic range of
+// keys under t_fold; part i starts at string first[i]. Strings with the
+// same key stay in one part, so a part ends only where the key changes.
+// Parts behind the last string are empty and have an empty first string.
+template<typename t_fold>
+std::vector<tVPSU> partition_by_range(const tVPSU& string_weight, size_t num_shards,
+                                      std::vector<std::string>& first) {
+    const size_t n = string_weight.size();
+    std::vector<tVPSU> parts(num_shards);
+    first.assign(num_shards, "");
+    for (size_t i=0, begin=0; i < num_shards; ++i) {
+        size_t end = std::max(begin, (i+1)*n/num_shards);
+        if ( end > 0 and end < n ) {
+            std::string last_key = t_fold::key(string_weight[end-1].first);
+            while ( end < n and t_fold::key(string_weight[end].first) == last_key ) {
+                ++end;
+            }
+        }
+        parts[i].assign(string_weight.begin()+begin, string_weight.begin()+end);
+        if ( i > 0 and begin < n ) {
+            first[i] = string_weight[begin].first;
+        }
+        begin = end;
+    }
+    return parts;
+}
+
+// Split a sorted list of (string, weight)-pairs into num_shards parts by
+// the hash value of their keys under t_fold. The parts stay sorted.
+template<typename t_fold>
+std::vector<tVPSU> partition_by_hash(const tVPSU& string_weight, size_t num_shards) {
+    std::vector<tVPSU> parts(num_shards);
+    for_each_key<t_fold>(string_weight, [&](size_t i, const std::string& key) {
+        parts[std::hash<std::string>()(key) % num_shards].push_back(string_weight[i]);
+    });
+    return parts;
+}
+
+// Front end of an index which is partitioned into shards. Each shard is
+// a web server which answers `/topk?q=prefix&k=10` with lines
+// `string\tweight`. A query is sent in parallel to the shards which may
+// contain matching strings, over non-blocking sockets of the querying
+// thread, and the result lists are merged by weight.
+// The shard map is a text file with the lines
+//   mode            range or hash
+//   fold            fold of the shard index (see case_fold.hpp)
+//   size            number of strings of all shards
+//   shard           address (host:port) and first string (range mode)
+// with tab separated fields; it is written by the `-shard` tool.
+class sharded_index {
+    struct shard {
+        std::string address;
+        std::string first; // smallest string of the shard in range mode
+    };
+
+    bool               m_hash = false;
+    std::string        m_fold = no_fold::name();
+    uint64_t           m_size = 0;
+    std::vector<shard> m_shards;
+
+    public:
+        typedef size_t size_type;
+        typedef no_cursor cursor_type;
+
+        sharded_index() = default;
+
+        // Create a shard map; for range partitioning first[i] is the first
+        // string of shard i, for hash partitioning first is empty. fold is
+        // the name of the fold of the shard index.
+        sharded_index(const std::vector<std::string>& addresses,
+                      const std::vector<std::string>& first,
+                      const std::string& fold, uint64_t size) :
+            m_hash(first.empty()), m_fold(fold), m_size(size) {
+            for (size_t i=0; i < addresses.size(); ++i) {
+                m_shards.push_back({addresses[i], m_hash ? "" : first[i]});
+            }
+        }
+
+        // Number of (string, weight)-pairs in all shards
+        size_type size() const {
+            return m_size;
+        }
+
+        // Shards which may contain strings starting with prefix
+        std::vector<size_t> shards_for(const std::string& prefix) const {
+            std::vector<size_t> res;
+            std::string p = key(prefix);
+            for (size_t i=0; i < m_shards.size(); ++i) {
+                if ( !m_hash ) {
+                    if ( i > 0 and m_shards[i].first.empty() ) {
+                        continue; // empty shard
+                    }
+                    // shard i contains the range [lo, hi), hi is the first
+                    // string of the next non-empty shard
+                    std::string lo = key(m_shards[i].first);
+                    if ( lo > p and lo.compare(0, p.size(), p) != 0 ) {
+                        break; // all later shards start behind prefix
+                    }
+                    size_t j = i+1;
+                    while ( j < m_shards.size() and m_shards[j].first.empty() ) {
+                        ++j;
+                    }
+                    if ( j < m_shards.size() and key(m_shards[j].first) <= p ) {
+                        continue;
+                    }
+                }
+                res.push_back(i);
+            }
+            return res;
+        }
+
+        // k > 0; shards which do not answer are left out of the result
+        tVPSU top_k(const std::string& prefix, size_t k) const {
+            auto shard_ids = shards_for(prefix);
+            std::vector<std::string> addresses, bodies;
+            for (size_t id : shard_ids) {
+                addresses.push_back(m_shards[id].address);
+            }
+            std::string path = "/topk?k=" + std::to_string(k) + "&q=" + http_client::url_encode(prefix);
+            auto ok = http_client::get_all(addresses, path, bodies);
+            std::vector<tVPSU> lists(shard_ids.size());
+            for (size_t i=0; i < shard_ids.size(); ++i) {
+                if ( ok[i] ) {
+                    parse_lines(bodies[i].data(), bodies[i].data()+bodies[i].size(), lists[i]);
+                } else {
+                    std::cerr << "Error: shard " << addresses[i] << " did not answer" << std::endl;
+                }
+            }
+            return merge_top_k(lists, k);
+        }
+
+        // k > 0
+        tVPSU top_k(const std::string& prefix, size_t k, cursor_type&) const {
+            return top_k(prefix, k);
+        }
+
+        // Answer top-k queries for several prefixes at once
+        std::vector<tVPSU> top_k_batch(const std::vector<std::string>& prefixes, size_t k) const {
+            return topkcomp::top_k_batch(*this, prefixes, k);
+        }
+
+        // Merge result lists, which are sorted by weight, into the top-k
+        static tVPSU merge_top_k(const std::vector<tVPSU>& lists, size_t k) {
+            tVPSU result_list;
+            for (const auto& l : lists) {
+                result_list.insert(result_list.end(), l.begin(), l.end());
+            }
+            std::stable_sort(result_list.begin(), result_list.end(), [](const tPSU& a, const tPSU& b){
+                return a.second > b.second;
+            });
+            if ( result_list.size() > k ) {
+                result_list.resize(k);
+            }
+            return result_list;
+        }
+
+        // Serialize method; writes the text shard map
+        size_type
+        serialize(std::ostream& out, sdsl::structure_tree_node* v=nullptr,
+                  std::string name="") const {
+            using namespace sdsl;
+            auto child = structure_tree::add_child(v, name, util::class_name(*this));
+            std::ostringstream map;
+            map << "mode\t" << (m_hash ? "hash" : "range") << "\n";
+            map << "fold\t" << m_fold << "\n";
+            map << "size\t" << m_size << "\n";
+            for (const auto& s : m_shards) {
+                map << "shard\t" << s.address << "\t" << s.first << "\n";
+            }
+            std::string text = map.str();
+            out.write(text.data(), text.size());
+            structure_tree::add_size(child, text.size());
+            return text.size();
+        }
+
+        // Load method; reads the text shard map
+        void load(std::istream& in) {
+            m_shards.clear();
+            std::string line;
+            while ( std::getline(in, line) ) {
+                std::vector<std::string> field;
+                std::istringstream fields(line);
+                std::string f;
+                while ( std::getline(fields, f, '\t') ) {
+                    field.push_back(f);
+                }
+                if ( field.size() < 2 ) {
+                    continue;
+                }
+                if ( field[0] == "mode" ) {
+                    m_hash = field[1] == "hash";
+                } else if ( field[0] == "fold" ) {
+                    m_fold = field[1];
+                } else if ( field[0] == "size" ) {
+                    m_size = std::stoull(field[1]);
+                } else if ( field[0] == "shard" ) {
+                    m_shards.push_back({field[1], field.size() > 2 ? field[2] : ""});
+                }
+            }
+        }
+
+    private:
+
+        // Strings are compared by their keys, as in the shard indexes
+        std::string key(const std::string& s) const {
+            return fold_key(m_fold, s);
+        }
+};
+
+// The front end can not build its index; the shard map is created by
+// the `-shard` tool
+inline double
+generate_index_from_file(sharded_index& index,
+                         const std::string& file,
+                         const std::string& index_file,
+                         const std::string&,
+                         const input_options& =input_options())
+{
+    std::ifstream in(index_file.c_str());
+    if ( in ) {
+        std::cout << "Load shard map from " << index_file << std::endl;
+        index.load(in);
+    } else {
+        std::cerr << "Error: Shard map " << index_file << " does not exist. ";
+        std::cerr << "Create it with the -shard tool for " << file << "." << std::endl;
+    }
+    return 0;
+}
+
+} // end namespace topkcomp
@@ -0,0 +1,184 @@
+#pragma once
+
+#include "index_common.hpp"
+#include <cctype>
+#include <sdsl/int_vector.hpp>
+#include <sdsl/bit_vectors.hpp>
+
+namespace topkcomp {
+
+// Original spellings of the strings of an index which stores the folded
+// keys of its strings. Only strings whose original differs from its key
+// are marked in m_str, and for each of them only the differing parts are
+// stored as a list of exceptions. An exception replaces key_len bytes of
+// the key by the org_len bytes of the original. It is encoded as varint
+// 2*gap+simple, where gap is the distance in the key to the end of the
+// previous exception. A simple exception replaces one ASCII letter by its
+// upper case, which is the common case and takes one byte; the others are
+// followed by the varints key_len and org_len and the original bytes.
+template<typename t_bv = sdsl::sd_vector<>,
+         typename t_rnk = typename t_bv::rank_1_type,
+         typename t_sel = typename t_bv::select_1_type>
+class spelling_exceptions {
+    t_bv                m_str;      // marks strings with exceptions
+    t_rnk               m_str_rnk;  // rank structure for m_str
+    t_bv                m_list;     // marks starts of the exception lists in m_data
+    t_sel               m_list_sel; // select structure for m_list
+    sdsl::int_vector<8> m_data;     // encoded exceptions
+
+    public:
+        typedef size_t size_type;
+
+        spelling_exceptions() = default;
+
+        // Constructor takes an input of (string, weight)-pairs (see
+        // for_each_pair) and the fold t_fold which maps the strings to
+        // their keys
+        template<typename t_input, typename t_fold>
+        spelling_exceptions(const t_input& string_weight, t_fold) {
+            using namespace sdsl;
+            sdsl::bit_vector str(string_weight.size(), 0);
+            std::string data;
+            tVU list_start;
+            for_each_pair(string_weight, [&](size_t i, const std::string& s, uint64_t) {
+                size_t begin = data.size();
+                append_exceptions<t_fold>(s, data);
+                if ( data.size() > begin ) {
+                    str[i] = 1;
+                    list_start.push_back(begin);
+                }
+            });
+            sdsl::bit_vector list(data.size()+1, 0);
+            for (auto p : list_start) {
+                list[p] = 1;
+            }
+            list[data.size()] = 1;
+            m_data = int_vector<8>(data.size());
+            std::copy(data.begin(), data.end(), m_data.begin());
+            m_str      = t_bv(str);
+            m_str_rnk  = t_rnk(&m_str);
+            m_list     = t_bv(list);
+            m_list_sel = t_sel(&m_list);
+        }
+
+        spelling_exceptions(const spelling_exceptions& e) {
+            *this = e;
+        }
+
+        spelling_exceptions& operator=(const spelling_exceptions& e) {
+            if ( this != &e ) {
+                m_str = e.m_str;
+                m_str_rnk = e.m_str_rnk;
+                m_str_rnk.set_vector(&m_str);
+                m_list = e.m_list;
+                m_list_sel = e.m_list_sel;
+                m_list_sel.set_vector(&m_list);
+                m_data = e.m_data;
+            }
+            return *this;
+        }
+
+        // Append the original of string idx, whose key is key[0..key_len), to res
+        void restore(size_t idx, const char* key, size_t key_len, std::string& res) const {
+            if ( idx >= m_str.size() or !m_str[idx] ) {
+                res.append(key, key_len);
+                return;
+            }
+            size_t j   = m_str_rnk(idx);
+            size_t p   = m_list_sel(j+1);
+            size_t end = m_list_sel(j+2);
+            size_t pos = 0; // position in key
+            while ( p < end ) {
+                uint64_t v = get_varint(m_data, p);
+                size_t begin = pos + v/2;
+                res.append(key+pos, begin-pos);
+                if ( v & 1 ) {
+                    res.push_back(std::toupper((uint8_t)key[begin]));
+                    pos = begin+1;
+                } else {
+                    size_t key_len_e = get_varint(m_data, p);
+                    size_t org_len   = get_varint(m_data, p);
+                    for (size_t i=0; i < org_len; ++i) {
+                        res.push_back(m_data[p++]);
+                    }
+                    pos = begin+key_len_e;
+                }
+            }
+            res.append(key+pos, key_len-pos);
+        }
+
+        // Serialize method
+        size_type
+        serialize(std::ostream& out, sdsl::structure_tree_node* v=nullptr,
+                  std::string name="") const {
+            using namespace sdsl;
+            auto child = structure_tree::add_child(v, name, util::class_name(*this));
+            size_type written_bytes = 0;
+            written_bytes += m_str.serialize(out, child, "str");
+            written_bytes += m_str_rnk.serialize(out, child, "str_rnk");
+            written_bytes += m_list.serialize(out, child, "list");
+            written_bytes += m_list_sel.serialize(out, child, "list_sel");
+            written_bytes += m_data.serialize(out, child, "data");
+            structure_tree::add_size(child, written_bytes);
+            return written_bytes;
+        }
+
+        // Load method
+        void load(std::istream& in) {
+            m_str.load(in);
+            m_str_rnk.load(in, &m_str);
+            m_list.load(in);
+            m_list_sel.load(in, &m_list);
+            m_data.load(in);
+        }
+
+    private:
+
+        // Append the exceptions of string s to data; adjacent replacements
+        // are joined into one exception
+        template<typename t_fold>
+        static void append_exceptions(const std::string& s, std::string& data) {
+            size_t key_pos  = 0; // position in the key
+            size_t prev_end = 0; // end of the last written exception in the key
+            // pending exception: key[e_begin..e_begin+e_key_len) -> e_org
+            size_t      e_begin = 0, e_key_len = 0;
+            std::string e_org;
+            bool        pending = false;
+            auto flush = [&]() {
+                if ( !pending ) {
+                    return;
+                }
+                size_t gap = e_begin - prev_end;
+                put_varint(2*gap, data);
+                put_varint(e_key_len, data);
+                put_varint(e_org.size(), data);
+                data += e_org;
+                prev_end = e_begin + e_key_len;
+                pending = false;
+            };
+            t_fold::fold(s, [&](size_t begin, size_t len, const std::string& f) {
+                if ( f.size() != len or s.compare(begin, len, f) != 0 ) {
+                    bool simple = len == 1 and f.size() == 1 and (uint8_t)f[0] < 128 and
+                                  std::toupper((uint8_t)f[0]) == (uint8_t)s[begin];
+                    if ( simple ) {
+                        flush();
+                        put_varint(2*(key_pos - prev_end)+1, data);
+                        prev_end = key_pos+1;
+                    } else if ( pending and e_begin + e_key_len == key_pos ) {
+                        e_key_len += f.size();
+                        e_org.append(s, begin, len);
+                    } else {
+                        flush();
+                        e_begin = key_pos;
+                        e_key_len = f.size();
+                        e_org.assign(s, begin, len);
+                        pending = true;
+                    }
+                }
+                key_pos += f.size();
+            });
+            flush();
+        }
+};
+
+} // end namespace topkcomp
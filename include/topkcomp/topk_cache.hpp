@@ -0,0 +1,148 @@
+#pragma once
+
+#include "index_common.hpp"
+#include <sdsl/int_vector.hpp>
+#include <sdsl/bit_vectors.hpp>
+
+namespace topkcomp {
+
+// Precomputed top-k lists for the upper part of a trie. For each node
+// whose sub tree contains at least t_min_size strings the indexes of the
+// t_k heaviest strings are stored in decreasing weight order, and if
+// t_labels is set also the strings themselves. Short prefixes end in
+// such nodes, so their queries are answered without range maximum
+// queries and label reconstruction. t_k = 0 disables the cache.
+template<uint32_t t_k = 0,
+         uint64_t t_min_size = 1024,
+         bool     t_labels = true>
+class topk_cache {
+    static_assert(t_k <= t_min_size, "every cached sub tree has to contain t_k strings");
+
+    sdsl::sd_vector<>                 m_cached;      // marks node ids with a stored list
+    sdsl::sd_vector<>::rank_1_type    m_cached_rank; // rank structure for m_cached
+    sdsl::int_vector<>                m_ids;         // t_k string indexes per cached node
+    sdsl::int_vector<8>               m_text;        // concatenation of the cached strings
+    sdsl::int_vector<>                m_text_start;  // start of the i-th string in m_text
+
+    public:
+        typedef size_t size_type;
+        constexpr static bool enabled = t_k > 0;
+
+        topk_cache() = default;
+
+        // Constructor takes the node ids of all nodes with at least
+        // t_min_size strings in increasing order and the largest node id n.
+        // top(i) returns the t_k heaviest string indexes in the sub tree of
+        // the i-th node, label(idx) the string at index idx.
+        template<typename t_top, typename t_label_fn>
+        topk_cache(const tVU& node_ids, size_t n, t_top top, t_label_fn label) {
+            using namespace sdsl;
+            if ( !enabled or node_ids.empty() ) {
+                return;
+            }
+            m_ids = int_vector<>(node_ids.size()*t_k, 0);
+            std::string text;
+            std::vector<size_t> text_start;
+            for (size_t i=0; i < node_ids.size(); ++i) {
+                auto top_idx = top(i);
+                for (size_t j=0; j < t_k; ++j) {
+                    m_ids[i*t_k+j] = top_idx[j];
+                    if ( t_labels ) {
+                        text_start.push_back(text.size());
+                        text += label(top_idx[j]);
+                    }
+                }
+            }
+            util::bit_compress(m_ids);
+            if ( t_labels ) {
+                text_start.push_back(text.size());
+                m_text = int_vector<8>(text.size());
+                std::copy(text.begin(), text.end(), m_text.begin());
+                m_text_start = int_vector<>(text_start.size(), 0, bits::hi(text.size())+1);
+                std::copy(text_start.begin(), text_start.end(), m_text_start.begin());
+            }
+            bit_vector cached(n+1, 0);
+            for (auto v_id : node_ids) {
+                cached[v_id] = 1;
+            }
+            m_cached = sd_vector<>(cached);
+            m_cached_rank = sd_vector<>::rank_1_type(&m_cached);
+        }
+
+        topk_cache(const topk_cache& c) {
+            *this = c;
+        }
+
+        topk_cache& operator=(const topk_cache& c) {
+            if ( this != &c ) {
+                m_cached = c.m_cached;
+                m_cached_rank = c.m_cached_rank;
+                m_cached_rank.set_vector(&m_cached);
+                m_ids = c.m_ids;
+                m_text = c.m_text;
+                m_text_start = c.m_text_start;
+            }
+            return *this;
+        }
+
+        // Length of the stored top-k lists
+        static constexpr size_t max_k() { return t_k; }
+
+        // Minimal number of strings in the sub tree of a cached node
+        static constexpr uint64_t min_size() { return t_min_size; }
+
+        // Check if the top-k list of node v_id is stored for k
+        // \returns the slot of the list or 0 if it is not stored
+        size_t find(size_t v_id, size_t k) const {
+            if ( k > t_k or v_id >= m_cached.size() or !m_cached[v_id] )
+                return 0;
+            return m_cached_rank(v_id)+1;
+        }
+
+        // Index of the i-th heaviest string of slot s
+        size_t id(size_t s, size_t i) const {
+            return m_ids[(s-1)*t_k+i];
+        }
+
+        // Check if the strings are stored
+        static constexpr bool has_labels() { return t_labels; }
+
+        // Append the i-th heaviest string of slot s to out; requires has_labels()
+        void append_label(size_t s, size_t i, std::string& out) const {
+            size_t j = (s-1)*t_k+i;
+            out.append(m_text.begin()+m_text_start[j], m_text.begin()+m_text_start[j+1]);
+        }
+
+        // Serialize method (calls serialize method of each member)
+        size_type
+        serialize(std::ostream& out, sdsl::structure_tree_node* v=nullptr,
+                  std::string name="") const {
+            using namespace sdsl;
+            auto child = structure_tree::add_child(v, name, util::class_name(*this));
+            size_type written_bytes = 0;
+            if ( !enabled ) { // a disabled cache leaves the format of the index unchanged
+                return written_bytes;
+            }
+            written_bytes += m_cached.serialize(out, child, "cached");
+            written_bytes += m_cached_rank.serialize(out, child, "cached_rank");
+            written_bytes += m_ids.serialize(out, child, "ids");
+            written_bytes += m_text.serialize(out, child, "text");
+            written_bytes += m_text_start.serialize(out, child, "text_start");
+            structure_tree::add_size(child, written_bytes);
+            return written_bytes;
+        }
+
+        // Load method (calls load method of each member)
+        void load(std::istream& in) {
+            if ( !enabled ) {
+                return;
+            }
+            m_cached.load(in);
+            m_cached_rank.load(in, &m_cached);
+            m_ids.load(in);
+            m_text.load(in);
+            m_text_start.load(in);
+        }
+};
+
+} // end namespace topkcomp
@@ -0,0 +1,240 @@
+#pragma once
+
+#include "index_common.hpp"
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace topkcomp {
+
+    // Immutable set of updated weights, sorted by string index. A max
+    // tree over the entries answers range maximum queries on the updated
+    // weights, so top-k queries enumerate the updated strings like the
+    // rmq enumerates the static ones.
+    class weight_updates {
+        std::vector<tPUU>   m_entries; // (index, weight)-pairs
+        std::vector<size_t> m_max;     // m_max[j]: position of the maximum below node j;
+                                       // leaf i is node m_entries.size()+i
+
+        // Check if the entry at position p beats the one at position q;
+        // equal weights are won by the smaller position
+        bool heavier(size_t p, size_t q) const {
+            return m_entries[p].second > m_entries[q].second or
+                   (m_entries[p].second == m_entries[q].second and p < q);
+        }
+
+        void build_max() {
+            size_t n = m_entries.size();
+            m_max.resize(2*n);
+            for (size_t i=0; i < n; ++i) {
+                m_max[n+i] = i;
+            }
+            for (size_t j=n-1; j > 0 and j < n; --j) {
+                size_t l = m_max[2*j], r = m_max[2*j+1];
+                m_max[j] = heavier(l, r) ? l : r;
+            }
+        }
+
+        // Position of the maximum weight in entries [lb, rb); lb < rb
+        size_t max_pos(size_t lb, size_t rb) const {
+            size_t res = lb;
+            for (lb += m_entries.size(), rb += m_entries.size(); lb < rb; lb >>= 1, rb >>= 1) {
+                if ( lb & 1 ) {
+                    if ( heavier(m_max[lb], res) ) res = m_max[lb];
+                    ++lb;
+                }
+                if ( rb & 1 ) {
+                    --rb;
+                    if ( heavier(m_max[rb], res) ) res = m_max[rb];
+                }
+            }
+            return res;
+        }
+
+        // Position of the first entry with index >= idx
+        size_t lower_pos(size_t idx) const {
+            return std::lower_bound(m_entries.begin(), m_entries.end(), tPUU(idx, 0)) - m_entries.begin();
+        }
+
+        public:
+            weight_updates() = default;
+
+            // Create the union of base and updates; updates win
+            weight_updates(const weight_updates& base, std::vector<tPUU> updates) {
+                std::stable_sort(updates.begin(), updates.end(), [](const tPUU& a, const tPUU& b){
+                    return a.first < b.first;
+                });
+                // keep the last update of each index
+                std::vector<tPUU> last;
+                for (size_t i=0; i < updates.size(); ++i) {
+                    if ( i+1 == updates.size() or updates[i].first != updates[i+1].first ) {
+                        last.push_back(updates[i]);
+                    }
+                }
+                auto it = base.m_entries.begin();
+                for (const auto& u : last) {
+                    while ( it != base.m_entries.end() and it->first < u.first ) {
+                        m_entries.push_back(*it++);
+                    }
+                    if ( it != base.m_entries.end() and it->first == u.first ) {
+                        ++it;
+                    }
+                    m_entries.push_back(u);
+                }
+                m_entries.insert(m_entries.end(), it, base.m_entries.end());
+                build_max();
+            }
+
+            bool empty() const { return m_entries.empty(); }
+
+            size_t size() const { return m_entries.size(); }
+
+            const std::vector<tPUU>& entries() const { return m_entries; }
+
+            // Check if the weight of idx was updated; if so it is returned in w
+            bool find(size_t idx, uint64_t& w) const {
+                size_t p = lower_pos(idx);
+                if ( p < m_entries.size() and m_entries[p].first == idx ) {
+                    w = m_entries[p].second;
+                    return true;
+                }
+                return false;
+            }
+
+            // Current weight of idx; w is the weight vector of the index
+            template<class t_rac_weight>
+            uint64_t weight(size_t idx, const t_rac_weight& w) const {
+                uint64_t res;
+                return find(idx, res) ? res : (uint64_t)w[idx];
+            }
+
+            // Indexes of the k strings of highest score in the union of
+            // disjoint ranges with respect to the updated weights; the score
+            // of idx in the i-th range is score(weight, i). Two heaps of
+            // intervals are merged lazily: one enumerates the static weights
+            // w with rmq and skips updated strings, the other enumerates the
+            // updated strings in the ranges with the max tree. So a query
+            // costs O(k log k) range maximum queries plus the skipped strings,
+            // independent of the number of updates.
+            template<class t_rac_weight, class t_rmq, class t_score>
+            tVU heaviest_indexes_in_ranges(size_t k, const std::vector<t_range>& ranges,
+                                           const t_rac_weight& w, const t_rmq& rmq,
+                                           t_score score) const {
+                return heaviest_indexes_in_ranges(k, ranges, w, rmq, score, [](size_t){ return false; });
+            }
+
+            // As above; indexes idx with skip(idx) = true are not reported
+            template<class t_rac_weight, class t_rmq, class t_score, class t_skip>
+            tVU heaviest_indexes_in_ranges(size_t k, const std::vector<t_range>& ranges,
+                                           const t_rac_weight& w, const t_rmq& rmq,
+                                           t_score score, t_skip skip) const {
+                uint64_t dummy;
+                auto updated = [&](size_t idx){ return find(idx, dummy); };
+                if ( m_entries.empty() ) {
+                    return topkcomp::heaviest_indexes_in_ranges(k, ranges, w, rmq, score, skip);
+                }
+                typedef weight_interval<decltype(score(uint64_t(0), size_t(0)))> t_interval;
+                std::priority_queue<t_interval> static_pq; // intervals of string indexes
+                std::priority_queue<t_interval> update_pq; // intervals of entry positions
+                auto push_static = [&](size_t f_lb, size_t f_rb, size_t f_r) {
+                    if ( f_rb > f_lb ) {
+                        size_t max_idx = rmq(f_lb, f_rb-1);
+                        static_pq.push(t_interval(score((uint64_t)w[max_idx], f_r), max_idx, f_lb, f_rb, f_r));
+                    }
+                };
+                auto push_update = [&](size_t f_lb, size_t f_rb, size_t f_r) {
+                    if ( f_rb > f_lb ) {
+                        size_t p = max_pos(f_lb, f_rb);
+                        update_pq.push(t_interval(score(m_entries[p].second, f_r), p, f_lb, f_rb, f_r));
+                    }
+                };
+                for (size_t i=0; i < ranges.size(); ++i) {
+                    push_static(ranges[i][0], ranges[i][1], i);
+                    push_update(lower_pos(ranges[i][0]), lower_pos(ranges[i][1]), i);
+                }
+                tVU res;
+                while ( res.size() < k ) {
+                    // the static maximum of an updated string is stale
+                    while ( !static_pq.empty() and (updated(static_pq.top().idx) or skip(static_pq.top().idx)) ) {
+                        auto iv = static_pq.top(); static_pq.pop();
+                        push_static(iv.lb, iv.idx, iv.r);
+                        push_static(iv.idx+1, iv.rb, iv.r);
+                    }
+                    if ( static_pq.empty() and update_pq.empty() ) {
+                        break;
+                    }
+                    if ( update_pq.empty() or (!static_pq.empty() and !(static_pq.top().s < update_pq.top().s)) ) {
+                        auto iv = static_pq.top(); static_pq.pop();
+                        res.push_back(iv.idx);
+                        push_static(iv.lb, iv.idx, iv.r);
+                        push_static(iv.idx+1, iv.rb, iv.r);
+                    } else {
+                        auto iv = update_pq.top(); update_pq.pop();
+                        if ( !skip(m_entries[iv.idx].first) ) {
+                            res.push_back(m_entries[iv.idx].first);
+                        }
+                        push_update(iv.lb, iv.idx, iv.r);
+                        push_update(iv.idx+1, iv.rb, iv.r);
+                    }
+                }
+                return res;
+            }
+
+            // Indexes of the k heaviest strings in range r with respect to
+            // the updated weights
+            template<class t_rac_weight, class t_rmq>
+            tVU heaviest_indexes_in_range(size_t k, t_range r, const t_rac_weight& w, const t_rmq& rmq) const {
+                return heaviest_indexes_in_ranges(k, std::vector<t_range>{r}, w, rmq,
+                                                  [](uint64_t weight, size_t){ return weight; });
+            }
+    };
+
+    // Mutable overlay of updated weights. Readers take a snapshot which
+    // stays valid while new updates are applied; writers replace the
+    // snapshot (copy-on-write) and are serialized by a mutex.
+    class weight_overlay {
+        std::shared_ptr<const weight_updates> m_updates = std::make_shared<const weight_updates>();
+        std::mutex                            m_mutex;
+
+        public:
+            weight_overlay() = default;
+
+            weight_overlay(const weight_overlay& o) : m_updates(o.snapshot()) {}
+
+            weight_overlay& operator=(const weight_overlay& o) {
+                if ( this != &o ) {
+                    std::atomic_store(&m_updates, o.snapshot());
+                }
+                return *this;
+            }
+
+            std::shared_ptr<const weight_updates> snapshot() const {
+                return std::atomic_load(&m_updates);
+            }
+
+            // Add (index, weight)-pairs to the overlay
+            void apply(const std::vector<tPUU>& updates) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                std::atomic_store(&m_updates, std::make_shared<const weight_updates>(*snapshot(), updates));
+            }
+
+            // Remove all updates
+            void clear() {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                std::atomic_store(&m_updates, std::make_shared<const weight_updates>());
+            }
+    };
+
+    // Check if t_index supports weight updates
+    template<typename t_index, typename = void>
+    struct supports_weight_updates : std::false_type {};
+
+    template<typename t_index>
+    struct supports_weight_updates<t_index,
+        decltype(std::declval<t_index&>().update_weights(tVPSU()), void())> : std::true_type {};
+
+} // end namespace topkcomp
@@ -0,0 +1,138 @@
+#include "topkcomp/index.hpp"
+#include <cstdio>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+using namespace std;
+using namespace sdsl;
+using namespace topkcomp;
+
+typedef INDEX_TYPE t_index;
+
+// Parse a comma separated list of k values, e.g. "1,5,10,100"
+vector<size_t> parse_k_list(const string& s) {
+    vector<size_t> ks;
+    stringstream ss(s);
+    string item;
+    while ( getline(ss, item, ',') ) {
+        if ( !item.empty() ) {
+            ks.push_back(stoull(item));
+        }
+    }
+    return ks;
+}
+
+// Read queries line by line. Everything after a tab is ignored, so
+// the (string, weight)-input of an index can be replayed directly.
+// In keystroke mode each line is expanded to all its non-empty prefixes
+// in typing order.
+vector<string> read_queries(const string& file, bool keystroke) {
+    vector<string> queries;
+    ifstream in(file.c_str());
+    string line;
+    while ( getline(in, line) ) {
+        line = line.substr(0, line.find('\t'));
+        if ( keystroke ) {
+            for (size_t i=1; i <= line.size(); ++i) {
+                queries.push_back(line.substr(0, i));
+            }
+        } else {
+            queries.push_back(line);
+        }
+    }
+    return queries;
+}
+
+// Nearest-rank percentile of sorted values
+uint64_t percentile(const vector<uint64_t>& sorted, double p) {
+    if ( sorted.empty() )
+        return 0;
+    size_t rank = (size_t)(p * sorted.size());
+    return sorted[min(rank, sorted.size()-1)];
+}
+
+int main(int argc, char* argv[]){
+    using clock = chrono::high_resolution_clock;
+    if ( argc < 3 ) {
+        cout << "Usage: ./" << argv[0] << " file queries [mode] [k-list]" << endl;
+        cout << "  Replays queries against a top-k completion index." << endl;
+        cout << "  file:    Input of the index. The index is stored in file.";
+        cout << INDEX_NAME << ".sdsl" << endl;
+        cout << "  queries: File with one query per line (tab separated suffix is ignored)." << endl;
+        cout << "  mode:    `full` to issue each line as prefix, `keystroke`" << endl;
+        cout << "           to issue all prefixes of each line, or `session` to issue" << endl;
+        cout << "           all prefixes of each line with one search cursor. Default: full." << endl;
+        cout << "  k-list:  Comma separated list of k values. Default: 1,5,10,100." << endl;
+        cout << "  Results are reported as `# key = value` lines." << endl;
+        return 1;
+    }
+    const string index_name = INDEX_NAME;
+    const string index_file = string(argv[1])+"."+INDEX_NAME+".sdsl";
+    const string mode       = argc > 3 ? argv[3] : "full";
+    const auto   ks         = parse_k_list(argc > 4 ? argv[4] : "1,5,10,100");
+    if ( mode != "full" and mode != "keystroke" and mode != "session" ) {
+        cerr << "Error: Unknown mode " << mode << endl;
+        return 1;
+    }
+
+    t_index topk_index;
+    // setup time covers loading or, if no index file exists, construction
+    auto setup_start = clock::now();
+    double construction_s = generate_index_from_file(topk_index, argv[1], index_file, index_name);
+    auto setup_ms = chrono::duration_cast<chrono::milliseconds>(clock::now() - setup_start).count();
+
+    auto queries = read_queries(argv[2], mode != "full");
+    if ( queries.empty() ) {
+        cerr << "Error: No queries in file " << argv[2] << endl;
+        return 1;
+    }
+
+    uint64_t index_bytes = size_in_bytes(topk_index);
+    cout << fixed << setprecision(3);
+    for (auto k : ks) {
+        vector<uint64_t> query_ns(queries.size());
+        uint64_t results = 0;
+        uint64_t checksum = 0; // keeps the compiler from dropping the queries
+        typename t_index::cursor_type cursor;
+        auto bench_start = clock::now();
+        for (size_t i=0; i < queries.size(); ++i) {
+            auto query_start = clock::now();
+            auto result_list = mode == "session" ? topk_index.top_k(queries[i], k, cursor)
+                                                 : topk_index.top_k(queries[i], k);
+            auto query_time  = clock::now() - query_start;
+            query_ns[i] = chrono::duration_cast<chrono::nanoseconds>(query_time).count();
+            results += result_list.size();
+            for (const auto& r : result_list) {
+                checksum += r.second + r.first.size();
+            }
+        }
+        auto bench_ns = chrono::duration_cast<chrono::nanoseconds>(clock::now() - bench_start).count();
+        sort(query_ns.begin(), query_ns.end());
+
+        cout << "# index = " << index_name << endl;
+        cout << "# mode = " << mode << endl;
+        cout << "# k = " << k << endl;
+        cout << "# queries = " << queries.size() << endl;
+        cout << "# results = " << results << endl;
+        cout << "# checksum = " << checksum << endl;
+        cout << "# strings = " << topk_index.size() << endl;
+        cout << "# size_in_bytes = " << index_bytes << endl;
+        cout << "# size_in_mega_bytes = " << size_in_mega_bytes(topk_index) << endl;
+        cout << "# bytes_per_string = " << (double)index_bytes / max((size_t)1, topk_index.size()) << endl;
+        cout << "# construction_s = " << construction_s << endl;
+        cout << "# setup_s = " << setup_ms / 1000.0 << endl;
+        cout << "# total_s = " << bench_ns / 1e9 << endl;
+        cout << "# throughput_qps = " << queries.size() / (bench_ns / 1e9) << endl;
+        cout << "# avg_us = " << bench_ns / 1e3 / queries.size() << endl;
+        cout << "# p50_us = " << percentile(query_ns, 0.50) / 1e3 << endl;
+        cout << "# p95_us = " << percentile(query_ns, 0.95) / 1e3 << endl;
+        cout << "# p99_us = " << percentile(query_ns, 0.99) / 1e3 << endl;
+        cout << "# p999_us = " << percentile(query_ns, 0.999) / 1e3 << endl;
+        cout << "# max_us = " << query_ns.back() / 1e3 << endl;
+    }
+}
@@ -0,0 +1,51 @@
+#include "topkcomp/index.hpp"
+#include "topkcomp/sharded_index.hpp"
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace sdsl;
+using namespace topkcomp;
+
+typedef INDEX_TYPE t_index;
+
+int main(int argc, char* argv[]){
+    const string index_name = INDEX_NAME;
+    if ( argc < 3 ) {
+        cout << "Usage: ./" << argv[0] << " file num_shards [range|hash] [first_port]" << endl;
+        cout << "  Splits file into the inputs file.shard0, file.shard1, ... of" << endl;
+        cout << "  num_shards web servers and writes their shard map to" << endl;
+        cout << "  file.shards.sdsl, which is read by the shards-frontend." << endl;
+        cout << "  range: each shard holds a lexicographic range (default)." << endl;
+        cout << "  hash: strings are assigned by hash value." << endl;
+        cout << "  first_port: shard i listens on 127.0.0.1:first_port+i. Default 8001." << endl;
+        return 1;
+    }
+    const string file = argv[1];
+    const size_t num_shards = stoull(argv[2]);
+    const bool hash = argc > 3 and string(argv[3]) == "hash";
+    const size_t first_port = argc > 4 ? stoull(argv[4]) : 8001;
+    typedef index_fold<t_index>::type t_fold;
+
+    tVPSU string_weight = read_sorted_input<t_fold>(file);
+    vector<string> first;
+    auto parts = hash ? partition_by_hash<t_fold>(string_weight, num_shards)
+                      : partition_by_range<t_fold>(string_weight, num_shards, first);
+    vector<string> addresses;
+    for (size_t i=0; i < num_shards; ++i) {
+        ofstream out(file+".shard"+to_string(i));
+        for (const auto& sw : parts[i]) {
+            out << sw.first << '\t' << sw.second << '\n';
+        }
+        addresses.push_back("127.0.0.1:"+to_string(first_port+i));
+        cout << "shard " << i << ": " << parts[i].size() << " strings; start with" << endl;
+        cout << "  ./" << index_name << "-webserver " << file << ".shard" << i << " " << first_port+i << endl;
+    }
+    sharded_index shard_map(addresses, first, t_fold::name(), string_weight.size());
+    store_to_file(shard_map, file+".shards.sdsl");
+    cout << "Shard map stored in " << file << ".shards.sdsl; start the front end with" << endl;
+    cout << "  ./shards-frontend " << file << " 8000 4" << endl;
+    cout << "Edit the addresses in the shard map to run shards on other hosts." << endl;
+}
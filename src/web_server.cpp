@@ -2,9 +2,27 @@
 // All rights reserved
 
 #include "topkcomp/index.hpp"
+#ifdef TOPKCOMP_SHARDS_FRONTEND
+#include "topkcomp/sharded_index.hpp"
+#endif
 #include <iostream>
 #include <string>
 #include <sstream>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <atomic>
+#include <unordered_map>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
 
 extern "C"
 {
@@ -34,44 +52,775 @@ typedef INDEX_TYPE t_index;
 
 static std::string s_http_port("8000");
 static struct mg_serve_http_opts s_http_server_opts;
-static t_index topk_index;
+static struct mg_mgr s_mgr;
+// The index is published RCU-style: queries take a reference with
+// std::atomic_load, a reload or compaction stores a new index with
+// std::atomic_store. An old index is freed when its last query is done.
+static std::shared_ptr<t_index> s_index = std::make_shared<t_index>();
+static std::string s_index_file;
+static std::atomic<bool>   s_reloading{false};
+static std::atomic<uint64_t> s_reloads{0};    // index files loaded after the start
+static size_t s_num_threads = 0; // 0 = answer queries in the event loop
+static latency_histogram     s_request_latency;  // time to compute a response
+static std::atomic<uint64_t> s_requests{0};       // answered /topcomp requests
+static std::atomic<uint64_t> s_batch_requests{0}; // answered /topcomp_batch requests
+
+// Format the i-th suggestion as JSON object
+std::string suggestion_json(const std::string& str, size_t i) {
+    return "{\"value\":\"" + escape_json( str ) + "\",\"data\":\"" + std::to_string(i) + "\"}";
+}
+
+// Format a result list as JSON array of suggestions
+std::string suggestions_array(const tVPSU& result_list) {
+    std::string data = "[";
+    for (size_t i=0; i<result_list.size(); ++i) {
+        if (i>0) data += ",";
+        data += suggestion_json(result_list[i].first, i);
+    }
+    data += "]";
+    return data;
+}
+
+// Format a result list as JSON for the jQuery-Autocomplete client
+std::string suggestions_json(const tVPSU& result_list) {
+    if ( result_list.empty() ){
+        return "{\"suggestions\":[\"value\":\"\",\"data\":\"\"]}\n";
+    }
+    return "{\"suggestions\":" + suggestions_array(result_list) + "}\n";
+}
+
+// Format the result lists of a batch query as JSON
+std::string batch_json(const std::vector<std::string>& prefixes,
+                       const std::vector<tVPSU>& result_lists) {
+    std::string data = "{\"results\":[";
+    for (size_t i=0; i<prefixes.size(); ++i) {
+        if (i>0) data += ",";
+        data += "{\"query\":\"" + escape_json( prefixes[i] ) + "\",";
+        data += "\"suggestions\":" + suggestions_array(result_lists[i]) + "}";
+    }
+    data += "]}\n";
+    return data;
+}
+
+// Format a result list as lines `string\tweight`; the answer of a
+// shard to its front end
+std::string result_lines(const tVPSU& result_list) {
+    std::string data;
+    for (const auto& sw : result_list) {
+        data += sw.first + "\t" + std::to_string(sw.second) + "\n";
+    }
+    return data;
+}
+
+// Get all values of variable name in an url encoded query string
+std::vector<std::string> get_http_vars(const struct mg_str* buf, const std::string& name) {
+    std::vector<std::string> values;
+    std::string query(buf->p, buf->p+buf->len);
+    size_t pos = 0;
+    while ( pos <= query.size() ) {
+        size_t end = std::min(query.find('&', pos), query.size());
+        size_t eq  = query.find('=', pos);
+        if ( eq < end and query.compare(pos, eq-pos, name) == 0 ) {
+            std::string value(end-eq, '\0');
+            int len = mg_url_decode(query.c_str()+eq+1, end-eq-1, &value[0], value.size(), 1);
+            if ( len >= 0 ) {
+                value.resize(len);
+                values.push_back(value);
+            }
+        }
+        pos = end+1;
+    }
+    return values;
+}
+
+// Send the headers of a chunked HTTP response
+void send_headers(struct mg_connection *nc, const std::string& content_type="") {
+    mg_printf(nc, "%s", "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n");
+    if ( !content_type.empty() ) {
+        mg_printf(nc, "Content-Type: %s\r\n", content_type.c_str());
+    }
+    mg_printf(nc, "%s", "\r\n");
+}
+
+// Send the last data of a chunked HTTP response and end it
+void end_response(struct mg_connection *nc, const std::string& data) {
+    if ( !data.empty() ) { // an empty chunk would end the response
+        mg_send_http_chunk(nc, data.data(), data.size());
+    }
+    mg_send_http_chunk(nc,"",0);//send empty chunk, the end of response
+}
+
+// Send data as complete chunked HTTP response
+void send_response(struct mg_connection *nc, const std::string& data,
+                   const std::string& content_type="") {
+    send_headers(nc, content_type);
+    end_response(nc, data);
+}
+
+// Refuse a request
+void send_forbidden(struct mg_connection *nc) {
+    mg_printf(nc, "%s", "HTTP/1.1 403 Forbidden\r\nContent-Length: 0\r\n\r\n");
+}
+
+// Check if the peer of nc connects over the loopback interface. Requests
+// which change the index are not authenticated, so they are only
+// answered for local clients.
+static bool local_peer(const struct mg_connection *nc) {
+    return nc->sa.sa.sa_family == AF_INET and (ntohl(nc->sa.sin.sin_addr.s_addr) >> 24) == 127;
+}
+
+struct query_job;
+
+// State of a connection, referenced by nc->user_data. The cursor keeps
+// the search position of the last prefix, so that a user typing one
+// character after the other only continues the search. The state is
+// shared with pending jobs, so it outlives a closed connection until
+// its last job is done. A connection has at most one job in flight,
+// so pipelined requests are answered in order and the worker owns the
+// cursor while it answers the job.
+struct connection_state {
+    uint64_t                id;           // key in s_connections
+    t_index::cursor_type    cursor;
+    std::weak_ptr<t_index>  cursor_index; // index the cursor refers to
+    bool                    busy = false; // a worker answers a job of the connection
+    std::deque<query_job*>  waiting;      // jobs received while busy
+};
+typedef std::shared_ptr<connection_state> t_conn_ptr;
+
+// Connections with state by id; only used by the event thread. Workers
+// refer to connections by id, since a connection may be closed before
+// its job is done.
+static std::unordered_map<uint64_t, struct mg_connection*> s_connections;
+static uint64_t s_next_conn_id = 0;
+
+// Get the state of connection nc; created at its first query
+t_conn_ptr connection(struct mg_connection *nc) {
+    if ( nc->user_data == NULL ) {
+        t_conn_ptr conn(new connection_state());
+        conn->id = s_next_conn_id++;
+        s_connections[conn->id] = nc;
+        nc->user_data = new t_conn_ptr(conn);
+    }
+    return *(t_conn_ptr*)nc->user_data;
+}
+
+// A query which is answered by a worker thread. Mongoose connections
+// may only be touched by the event thread, so the job refers to its
+// connection by the connection state.
+struct query_job {
+    t_conn_ptr               conn;
+    std::vector<std::string> prefixes;
+    size_t                   k;
+    size_t                   edits;     // maximal edit distance of a fuzzy query
+    std::string              uri;       // selects the kind of request
+    bool                     compact;   // compact or merge the index after an update
+    std::string              body;
+    std::string              response;  // the rest of the response after the flushed chunks
+    bool                     streamed;  // headers and first chunks were already sent
+};
+
+// Sends a chunk of a streamed response
+typedef std::function<void(const std::string&)> t_flush;
+
+static const size_t      s_max_edits = 2;              // bound of the query latency
+static const size_t      s_max_k = 1000;               // bound of the result size
+
+// Value of an unsigned query parameter clamped to max_value; def if the
+// parameter is missing or not a number
+static size_t bounded_var(const struct mg_str* query, const char* name, size_t def, size_t max_value) {
+    char buf[16];
+    int len = mg_get_http_var(query, name, buf, sizeof(buf));
+    if ( len <= 0 or buf[0] < '0' or buf[0] > '9' ) {
+        return def;
+    }
+    return (size_t)std::min((unsigned long long)max_value, std::strtoull(buf, nullptr, 10));
+}
+
+// Answer a query with up to job.edits typos if the index supports it
+template<class t_idx>
+tVPSU fuzzy_top_k(const t_idx& index, const query_job& job, std::true_type) {
+    return index.top_k_fuzzy(job.prefixes[0], job.k, job.edits);
+}
+
+template<class t_idx>
+tVPSU fuzzy_top_k(const t_idx& index, const query_job& job, std::false_type) {
+    return index.top_k(job.prefixes[0], job.k);
+}
+
+// Answer of /topk as result lines. Indexes which decode into a result_arena
+// reuse one arena per worker thread, so the decoded strings are not
+// allocated for each query.
+template<class t_idx>
+std::string topk_lines(const t_idx& index, const query_job& job, std::true_type) {
+    static thread_local result_arena arena;
+    index.top_k(job.prefixes[0], job.k, arena);
+    std::string data;
+    for (size_t i=0; i<arena.size(); ++i) {
+        data.append(arena.text, arena.pos[i].first, arena.pos[i].second);
+        data += "\t" + std::to_string(arena.weight[i]) + "\n";
+    }
+    return data;
+}
+
+template<class t_idx>
+std::string topk_lines(const t_idx& index, const query_job& job, std::false_type) {
+    return result_lines(index.top_k(job.prefixes[0], job.k));
+}
+
+static std::mutex        s_update_mutex;             // serializes updates, compactions and reloads
+static std::atomic<bool> s_compacting{false};
+static const size_t      s_compact_threshold = 100000; // compact if more updates are pending
+static const size_t      s_merge_threshold = 10000;    // merge if more insertions are pending
+
+// Version of a file: a file replaced by `mv` has a new inode, a file
+// rewritten in place a new size or modification time
+struct file_version {
+    ino_t  ino = 0;
+    off_t  size = 0;
+    time_t mtime = 0; // 0 if the file does not exist
+    long   mtime_ns = 0;
+
+    bool operator==(const file_version& v) const {
+        return ino == v.ino and size == v.size and mtime == v.mtime and mtime_ns == v.mtime_ns;
+    }
+};
+
+// Current version of file
+file_version current_version(const std::string& file) {
+    file_version v;
+    struct stat st;
+    if ( stat(file.c_str(), &st) == 0 ) {
+        v.ino = st.st_ino;
+        v.size = st.st_size;
+        v.mtime = st.st_mtim.tv_sec;
+        v.mtime_ns = st.st_mtim.tv_nsec;
+    }
+    return v;
+}
+
+static std::mutex   s_version_mutex;  // protects s_index_version
+static file_version s_index_version;  // version of the loaded index file
+
+void set_index_version(const file_version& v) {
+    std::lock_guard<std::mutex> lock(s_version_mutex);
+    s_index_version = v;
+}
+
+file_version index_version() {
+    std::lock_guard<std::mutex> lock(s_version_mutex);
+    return s_index_version;
+}
+
+// Serialized index. It is taken while s_update_mutex is held, so the
+// slow file write in store_index does not block updates.
+template<class t_idx>
+std::string serialized_index(const t_idx& index) {
+    std::ostringstream out;
+    index.serialize(out);
+    return out.str();
+}
+
+// Store a serialized index atomically to the index file; a crash keeps
+// the old file
+void store_index(const std::string& data) {
+    std::string tmp_file = s_index_file+".tmp";
+    {
+        std::ofstream out(tmp_file, std::ios::binary | std::ios::trunc);
+        out.write(data.data(), data.size());
+        if ( !out.flush() ) {
+            std::cerr << "Error: Could not write " << tmp_file << std::endl;
+            return;
+        }
+    }
+    std::rename(tmp_file.c_str(), s_index_file.c_str());
+    set_index_version(current_version(s_index_file)); // no reload of our own file
+}
+
+// Response to a request which changes the index while a compaction,
+// merge or reload holds s_update_mutex; the client retries later
+const std::string s_busy_response = "{\"busy\":true}\n";
+
+// Number of weight updates or insertions and deletions of index which
+// are not yet in the index file
+template<class t_idx>
+size_t pending_updates(const t_idx& index, std::true_type) {
+    return index.updated_weights().size();
+}
+
+template<class t_idx>
+size_t pending_updates(const t_idx&, std::false_type) {
+    return 0;
+}
+
+template<class t_idx>
+size_t pending_insertions(const t_idx& index, std::true_type) {
+    return index.delta_size();
+}
+
+template<class t_idx>
+size_t pending_insertions(const t_idx&, std::false_type) {
+    return 0;
+}
+
+size_t pending_changes(const t_index& index) {
+    return pending_updates(index, supports_weight_updates<t_index>()) +
+           pending_insertions(index, supports_insertions<t_index>());
+}
+
+// Load the index file in the background and publish the new index.
+// Queries continue on the old index. The file is not loaded while the
+// index has changes which are not compacted, since they would be lost,
+// or while a compaction or merge runs, since it writes the index file;
+// the watcher tries again later.
+void reload_index() {
+    static file_version refused; // version whose reload was refused last
+    {
+        std::lock_guard<std::mutex> lock(s_update_mutex);
+        file_version version = current_version(s_index_file);
+        size_t pending = pending_changes(*std::atomic_load(&s_index));
+        auto new_index = std::make_shared<t_index>();
+        if ( s_compacting ) {
+            // the compaction stores the index file
+        } else if ( pending > 0 ) {
+            if ( !(version == refused) ) {
+                std::cerr << "Error: Did not reload index from " << s_index_file << "; "
+                          << pending << " changes are not compacted" << std::endl;
+                refused = version;
+            }
+        } else {
+            if ( load_from_mapped_file(*new_index, s_index_file) ) {
+                std::atomic_store(&s_index, new_index);
+                s_reloads.fetch_add(1, std::memory_order_relaxed);
+                std::cout << "Reloaded index from " << s_index_file << std::endl;
+            } else {
+                std::cerr << "Error: Could not reload index from " << s_index_file << std::endl;
+            }
+            set_index_version(version);
+        }
+    }
+    s_reloading = false;
+}
+
+// Start a reload unless one is running; \returns true if started
+bool start_reload() {
+    bool expected = false;
+    if ( s_reloading.compare_exchange_strong(expected, true) ) {
+        std::thread(reload_index).detach();
+        return true;
+    }
+    return false;
+}
+
+// Reload the index file if it was replaced. The file is checked at
+// most once per second. A file is only picked up after it was not
+// modified for two seconds, so that a file which is still being written
+// is not loaded.
+void watch_index_file(time_t now) {
+    static time_t last_check = 0;
+    if ( now == last_check ) {
+        return;
+    }
+    last_check = now;
+    file_version version = current_version(s_index_file);
+    if ( version.mtime != 0 and !(version == index_version()) and now - version.mtime >= 2 ) {
+        start_reload();
+    }
+}
+
+// Replace the index by a copy with compacted weights, which is also
+// stored to the index file. Queries use the old index until the swap;
+// updates are answered with s_busy_response until the swap, the file is
+// written after it.
+template<class t_idx>
+void compact_index() {
+    std::string data;
+    {
+        std::lock_guard<std::mutex> lock(s_update_mutex);
+        std::shared_ptr<t_idx> old_index = std::atomic_load(&s_index);
+        std::shared_ptr<t_idx> new_index = std::make_shared<t_idx>();
+        // copy the index without its updates; the index file may already
+        // hold a new index, whose string indexes differ
+        std::stringstream copy;
+        old_index->serialize(copy);
+        new_index->load(copy);
+        new_index->update_weights(old_index->updated_weights());
+        new_index->compact();
+        data = serialized_index(*new_index);
+        std::atomic_store(&s_index, new_index);
+    }
+    store_index(data);
+    s_compacting = false;
+}
+
+// Apply the weight updates in body, which has the format of the input
+// file (lines `string\tweight`), and start a compaction if requested or
+// too many updates are pending
+template<class t_idx>
+std::string update_weights(const query_job& job, std::true_type) {
+    tVPSU string_weight;
+    parse_lines(job.body.data(), job.body.data()+job.body.size(), string_weight);
+    size_t updated, pending;
+    {
+        std::unique_lock<std::mutex> lock(s_update_mutex, std::try_to_lock);
+        if ( !lock.owns_lock() ) {
+            return s_busy_response;
+        }
+        std::shared_ptr<t_idx> index = std::atomic_load(&s_index);
+        updated = index->update_weights(string_weight);
+        pending = index->updated_weights().size();
+    }
+    bool expected = false;
+    if ( (job.compact or pending >= s_compact_threshold)
+         and s_compacting.compare_exchange_strong(expected, true) ) {
+        std::thread(compact_index<t_idx>).detach();
+    }
+    return "{\"updated\":" + std::to_string(updated) +
+           ",\"ignored\":" + std::to_string(string_weight.size()-updated) +
+           ",\"pending\":" + std::to_string(pending) + "}\n";
+}
+
+template<class t_idx>
+std::string update_weights(const query_job&, std::false_type) {
+    return "{\"error\":\"index does not support weight updates\"}\n";
+}
+
+// Merge the delta of recent insertions and deletions into the index and
+// store it. The index answers queries, insertions and deletions during
+// the merge; only the serialization of the merged index holds
+// s_update_mutex, the file is written after it.
+template<class t_idx>
+void merge_index() {
+    std::shared_ptr<t_idx> index = std::atomic_load(&s_index);
+    index->merge();
+    std::string data;
+    {
+        // a reload must not be overwritten by the merged index
+        std::lock_guard<std::mutex> lock(s_update_mutex);
+        if ( std::atomic_load(&s_index) == index ) {
+            data = serialized_index(*index);
+        }
+    }
+    if ( !data.empty() ) {
+        store_index(data);
+    }
+    s_compacting = false;
+}
+
+// Insert the (string, weight)-pairs in body (lines `string\tweight`) or
+// delete the strings in body (one per line) and start a merge if
+// requested or too many changes are pending
+template<class t_idx>
+std::string insert_strings(const query_job& job, std::true_type) {
+    tVPSU string_weight;
+    std::vector<std::string> strings;
+    if ( job.uri == "/insert" ) {
+        parse_lines(job.body.data(), job.body.data()+job.body.size(), string_weight);
+    } else {
+        std::istringstream in(job.body);
+        std::string line;
+        while ( std::getline(in, line) ) {
+            if ( !line.empty() ) {
+                strings.push_back(line);
+            }
+        }
+    }
+    size_t changed = 0, pending;
+    {
+        // a reload must not swap the index while it is changed
+        std::unique_lock<std::mutex> lock(s_update_mutex, std::try_to_lock);
+        if ( !lock.owns_lock() ) {
+            return s_busy_response;
+        }
+        std::shared_ptr<t_idx> index = std::atomic_load(&s_index);
+        if ( job.uri == "/insert" ) {
+            index->insert(string_weight);
+            changed = string_weight.size();
+        } else {
+            index->erase(strings);
+            changed = strings.size();
+        }
+        pending = index->delta_size();
+    }
+    bool expected = false;
+    if ( (job.compact or pending >= s_merge_threshold)
+         and s_compacting.compare_exchange_strong(expected, true) ) {
+        std::thread(merge_index<t_idx>).detach();
+    }
+    return "{\"" + std::string(job.uri == "/insert" ? "inserted" : "deleted") + "\":" +
+           std::to_string(changed) + ",\"pending\":" + std::to_string(pending) + "}\n";
+}
+
+template<class t_idx>
+std::string insert_strings(const query_job&, std::false_type) {
+    return "{\"error\":\"index does not support insertions\"}\n";
+}
+
+// Compute the JSON response of a job. Suggestions are streamed: the
+// first chunks are passed to flush after 1, 2, 4, ... results, so that
+// the client can show them before all k results are decoded. The
+// returned string is the rest of the response.
+std::string answer(const query_job& job, const t_flush& flush) {
+    if ( job.uri == "/update" ) {
+        return update_weights<t_index>(job, supports_weight_updates<t_index>());
+    }
+    if ( job.uri == "/insert" or job.uri == "/delete" ) {
+        return insert_strings<t_index>(job, supports_insertions<t_index>());
+    }
+    stage_timer timer(s_request_latency);
+    auto index = std::atomic_load(&s_index);
+    if ( job.uri == "/topcomp_batch" ) {
+        s_batch_requests.fetch_add(1, std::memory_order_relaxed);
+        return batch_json(job.prefixes, index->top_k_batch(job.prefixes, job.k));
+    }
+    s_requests.fetch_add(1, std::memory_order_relaxed);
+    if ( job.uri == "/topk" ) {
+        return topk_lines(*index, job, supports_arena<t_index>());
+    }
+    if ( job.edits > 0 ) {
+        return suggestions_json(fuzzy_top_k(*index, job, supports_fuzzy_search<t_index>()));
+    }
+    if ( job.conn->cursor_index.lock() != index ) { // the index was swapped
+        job.conn->cursor = t_index::cursor_type();
+        job.conn->cursor_index = index;
+    }
+    std::string data = "{\"suggestions\":[";
+    size_t n = 0, next_flush = 1;
+    top_k_stream(*index, job.prefixes[0], job.k, job.conn->cursor, [&](const std::string& str, uint64_t){
+        if (n>0) data += ",";
+        data += suggestion_json(str, n);
+        if ( ++n == next_flush and n < job.k ) {
+            flush(data);
+            data.clear();
+            next_flush *= 2;
+        }
+    });
+    if ( n == 0 ) {
+        return suggestions_json(tVPSU());
+    }
+    return data + "]}\n";
+}
+
+// Queue of jobs (or other items) shared by threads
+template<class t_item>
+class job_queue {
+    std::mutex                m_mutex;
+    std::condition_variable   m_cv;
+    std::deque<t_item>        m_jobs;
+  public:
+    // \returns true if the queue was empty
+    bool push(t_item job) {
+        bool was_empty;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            was_empty = m_jobs.empty();
+            m_jobs.push_back(job);
+        }
+        m_cv.notify_one();
+        return was_empty;
+    }
+
+    size_t size() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_jobs.size();
+    }
+
+    t_item pop() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this]{ return !m_jobs.empty(); });
+        t_item job = m_jobs.front();
+        m_jobs.pop_front();
+        return job;
+    }
+
+    // Remove all jobs without waiting
+    std::deque<t_item> pop_all() {
+        std::deque<t_item> jobs;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        jobs.swap(m_jobs);
+        return jobs;
+    }
+};
+// A chunk of a streamed response which a worker passes to the event thread
+struct response_chunk {
+    t_conn_ptr  conn;
+    std::string data;
+    bool        first; // the headers are sent before the first chunk
+};
+
+static job_queue<query_job*>     s_jobs;   // jobs waiting for a worker
+static job_queue<query_job*>     s_done;   // answered jobs waiting for the event thread
+static job_queue<response_chunk> s_chunks; // flushed chunks waiting for the event thread
+// A worker writes a byte to s_wakeup[1] if s_done or s_chunks was empty.
+// The event thread receives it on s_wakeup[0] and sends all queued chunks
+// and responses, so a burst of chunks costs one wake up.
+static sock_t    s_wakeup[2];
+
+// Format server and index metrics in Prometheus text format
+std::string metrics_text() {
+    std::ostringstream out;
+    out << "# HELP topkcomp_requests_total Answered top-k requests.\n";
+    out << "# TYPE topkcomp_requests_total counter\n";
+    out << "topkcomp_requests_total{endpoint=\"/topcomp\"} " << s_requests.load() << "\n";
+    out << "topkcomp_requests_total{endpoint=\"/topcomp_batch\"} " << s_batch_requests.load() << "\n";
+    out << "# HELP topkcomp_request_seconds Time to compute the response of a request.\n";
+    out << "# TYPE topkcomp_request_seconds histogram\n";
+    s_request_latency.write(out, "topkcomp_request_seconds", "");
+    out << "# HELP topkcomp_pending_jobs Requests waiting for a worker thread.\n";
+    out << "# TYPE topkcomp_pending_jobs gauge\n";
+    out << "topkcomp_pending_jobs " << s_jobs.size() << "\n";
+    out << "# HELP topkcomp_index_reloads_total Index files loaded after the start.\n";
+    out << "# TYPE topkcomp_index_reloads_total counter\n";
+    out << "topkcomp_index_reloads_total " << s_reloads.load() << "\n";
+    metrics().write(out);
+    return out.str();
+}
+
+// Pass a job to the workers or let it wait for the job in flight of
+// its connection
+void submit(query_job* job) {
+    if ( job->conn->busy ) {
+        job->conn->waiting.push_back(job);
+    } else {
+        job->conn->busy = true;
+        s_jobs.push(job);
+    }
+}
+
+// Send the response of an answered job if its connection is still open
+// and submit the next job of the connection
+void finish(query_job* job) {
+    auto it = s_connections.find(job->conn->id);
+    if ( it != s_connections.end() ) {
+        if ( job->streamed ) {
+            end_response(it->second, job->response);
+        } else {
+            send_response(it->second, job->response);
+        }
+    }
+    job->conn->busy = false;
+    if ( !job->conn->waiting.empty() ) {
+        query_job* next = job->conn->waiting.front();
+        job->conn->waiting.pop_front();
+        submit(next);
+    }
+    delete job;
+}
+
+// Send a flushed chunk if its connection is still open
+void send_chunk(const response_chunk& chunk) {
+    auto it = s_connections.find(chunk.conn->id);
+    if ( it != s_connections.end() ) {
+        if ( chunk.first ) {
+            send_headers(it->second);
+        }
+        mg_send_http_chunk(it->second, chunk.data.data(), chunk.data.size());
+    }
+}
+
+// Called in the event thread when workers have flushed chunks or answered
+// jobs. The answered jobs are taken before the chunks: a worker queues
+// the chunks of a job before the job, so all chunks of the taken jobs
+// are sent before their rest.
+static void done_handler(struct mg_connection *nc, int ev, void *p) {
+    (void)p;
+    if ( ev == MG_EV_RECV ) {
+        mbuf_remove(&nc->recv_mbuf, nc->recv_mbuf.len); // wake up bytes
+        auto done = s_done.pop_all();
+        for (const response_chunk& chunk : s_chunks.pop_all()) {
+            send_chunk(chunk);
+        }
+        for (query_job* job : done) {
+            finish(job);
+        }
+    }
+}
+
+// Worker threads answer queries; the index is read-only after loading.
+// Flushed chunks are queued for the event thread without waiting for it.
+static void worker() {
+    for (;;) {
+        query_job* job = s_jobs.pop();
+        job->response = answer(*job, [job](const std::string& data) {
+            bool first = !job->streamed;
+            job->streamed = true;
+            if ( s_chunks.push(response_chunk{job->conn, data, first}) ) {
+                send(s_wakeup[1], "", 1, 0);
+            }
+        });
+        if ( s_done.push(job) ) {
+            send(s_wakeup[1], "", 1, 0);
+        }
+    }
+}
 
 static void ev_handler(struct mg_connection *nc, int ev, void *p) {
-  if (ev == MG_EV_HTTP_REQUEST) {
+  if (ev == MG_EV_CLOSE) {
+    if ( nc->user_data != NULL ) {
+        t_conn_ptr conn = *(t_conn_ptr*)nc->user_data;
+        s_connections.erase(conn->id);
+        for (query_job* job : conn->waiting) {
+            delete job;
+        }
+        conn->waiting.clear();
+        delete (t_conn_ptr*)nc->user_data;
+        nc->user_data = NULL;
+    }
+  } else if (ev == MG_EV_HTTP_REQUEST) {
     struct http_message *hm = (struct http_message *) p;
     std::string uri = std::string(hm->uri.p, (hm->uri.p)+(hm->uri.len));
 
-    if ( uri == "/topcomp" ) {
-        std::string prefix = "";
-        size_t k           = 10;
-        char prefix_buf[128];
-        int prefix_len = mg_get_http_var(&(hm->query_string), "q", prefix_buf, 128); 
-        if ( prefix_len > 0 ) {
-            prefix = std::string(prefix_buf, prefix_buf+prefix_len);
+    if ( uri == "/topcomp" or uri == "/topcomp_batch" or uri == "/topk" or
+         uri == "/update" or uri == "/insert" or uri == "/delete" ) {
+        bool changes_index = uri == "/update" or uri == "/insert" or uri == "/delete";
+        if ( changes_index and !local_peer(nc) ) {
+            send_forbidden(nc);
+            return;
         }
-        char k_buf[16];
-        int k_len = mg_get_http_var(&(hm->query_string), "k", k_buf, 16); 
-        if ( k_len > 0 ) {
-            k = std::stoull(std::string(k_buf, k_buf+k_len));
+        query_job job{connection(nc), {}, 10, 0, uri, false, "", "", false};
+        if ( changes_index ) {
+            job.body = std::string(hm->body.p, hm->body.p+hm->body.len);
+            job.compact = !get_http_vars(&(hm->query_string), "compact").empty();
+        } else if ( uri == "/topcomp_batch" ) {
+            job.prefixes = get_http_vars(&(hm->query_string), "q");
+        } else {
+            std::string prefix = "";
+            char prefix_buf[128];
+            int prefix_len = mg_get_http_var(&(hm->query_string), "q", prefix_buf, 128); 
+            if ( prefix_len > 0 ) {
+                prefix = std::string(prefix_buf, prefix_buf+prefix_len);
+            }
+            job.prefixes.push_back(prefix);
         }
+        job.k = bounded_var(&(hm->query_string), "k", job.k, s_max_k);
+        job.edits = bounded_var(&(hm->query_string), "d", job.edits, s_max_edits);
 
-        std::string data;
-        auto result_list = topk_index.top_k(prefix, k);
-        if ( result_list.empty() ){
-            data =  "{\"suggestions\":[\"value\":\"\",\"data\":\"\"]}\n";
-        } else {
-            data =  "{\"suggestions\":[";
-            for (size_t i=0; i<result_list.size(); ++i) {
-                if (i>0) data += ",";
-                data += "{\"value\":\"" + escape_json( result_list[i].first ) + "\",";
-                data +=  "\"data\":\""+ std::to_string(i)+ "\"}";
+        if ( s_num_threads == 0 ) {
+            std::string rest = answer(job, [&](const std::string& data) {
+                if ( !job.streamed ) {
+                    send_headers(nc);
+                    job.streamed = true;
+                }
+                mg_send_http_chunk(nc, data.data(), data.size());
+            });
+            if ( job.streamed ) {
+                end_response(nc, rest);
+            } else {
+                send_response(nc, rest);
             }
-            data += "]}\n";
+        } else {
+            submit(new query_job(std::move(job)));
+        }
+    } else if ( uri == "/reload" ) {
+        if ( !local_peer(nc) ) {
+            send_forbidden(nc);
+            return;
         }
-        /* Send headers */
-        mg_printf(nc, "%s", "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n");
-        mg_printf_http_chunk(nc, data.c_str(), data.size());
-        mg_send_http_chunk(nc,"",0);//send empty chunk, the end of response
+        size_t pending = pending_changes(*std::atomic_load(&s_index));
+        bool started = pending == 0 and start_reload();
+        send_response(nc, std::string("{\"reloading\":") + (started ? "true" : "false") +
+                          ",\"pending\":" + std::to_string(pending) + "}\n");
+    } else if ( uri == "/metrics" ) {
+        send_response(nc, metrics_text(), "text/plain; version=0.0.4");
     } else {
         mg_serve_http(nc, (struct http_message *) p, s_http_server_opts);
     }
@@ -81,39 +830,53 @@ static void ev_handler(struct mg_connection *nc, int ev, void *p) {
 
 
 int main(int argc, char* argv[]){
-  const std::string index_name = INDEX_NAME;
-  const std::string index_file = std::string(argv[1])+"."+INDEX_NAME+".sdsl";
-  std::cout<<"index file="<<index_file<<std::endl;
-  
   if ( argc < 2 ) {
-      std::cout << "Usage: ./" << argv[0] << " file [port]" << std::endl;
+      std::cout << "Usage: ./" << argv[0] << " file [port] [threads]" << std::endl;
       std::cout << "  file: File for which an index file exists." << std::endl;
       std::cout << "  port: Webserver port. Default 8000." << std::endl;
+      std::cout << "  threads: Number of worker threads which answer queries." << std::endl;
+      std::cout << "           Default 0, i.e. queries are answered in the event loop." << std::endl;
       return 1;
   }
+  const std::string index_name = INDEX_NAME;
+  const std::string index_file = std::string(argv[1])+"."+INDEX_NAME+".sdsl";
+  std::cout<<"index file="<<index_file<<std::endl;
   if ( argc > 2 ) {
     s_http_port = argv[2];
   }
+  if ( argc > 3 ) {
+    s_num_threads = std::stoull(argv[3]);
+  }
   
-  generate_index_from_file(topk_index, argv[1], index_file, index_name);
+  s_index_file = index_file;
+  generate_index_from_file(*s_index, argv[1], index_file, index_name);
+  set_index_version(current_version(index_file));
 
-  struct mg_mgr mgr;
   struct mg_connection *nc;
 
-  mg_mgr_init(&mgr, NULL);
-  nc = mg_bind(&mgr, s_http_port.c_str(), ev_handler);
+  mg_mgr_init(&s_mgr, NULL);
+  nc = mg_bind(&s_mgr, s_http_port.c_str(), ev_handler);
 
   // Set up HTTP server parameters
   mg_set_protocol_http_websocket(nc);
   s_http_server_opts.document_root = "../web";
   s_http_server_opts.enable_directory_listing = "no";
 
-  printf("Starting web server on port %s\n", s_http_port.c_str());
+  if ( s_num_threads > 0 ) {
+    mg_socketpair(s_wakeup, SOCK_STREAM);
+    mg_add_sock(&s_mgr, s_wakeup[0], done_handler);
+  }
+  for (size_t i=0; i < s_num_threads; ++i) {
+    std::thread(worker).detach();
+  }
+
+  printf("Starting web server on port %s with %zu worker threads\n", s_http_port.c_str(), s_num_threads);
   
   for (;;) {
-    mg_mgr_poll(&mgr, 1000);
+    time_t now = mg_mgr_poll(&s_mgr, 1000);
+    watch_index_file(now);
   }
-  mg_mgr_free(&mgr);
+  mg_mgr_free(&s_mgr);
 
   return 0;
 }